@@ -0,0 +1,215 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <sol/sol.hpp>
+#include "curling.hpp"
+#include "lua_allocator.hpp"
+#include "repl.hpp"
+
+namespace bench {
+
+// === :time and :bench for the REPL ===
+// Chunks are compiled before the clock starts, so only running them is measured. Wall time
+// includes network waits; CPU time is the whole process, curl's resolver threads included.
+// Allocations are those of the Lua state, as counted by its allocator.
+
+inline std::int64_t cpu_now_ns() {
+    timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return static_cast<std::int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+inline std::string format_duration(double ns) {
+    char text[32];
+    if (ns < 1e3) std::snprintf(text, sizeof text, "%.0f ns", ns);
+    else if (ns < 1e6) std::snprintf(text, sizeof text, "%.2f us", ns / 1e3);
+    else if (ns < 1e9) std::snprintf(text, sizeof text, "%.2f ms", ns / 1e6);
+    else std::snprintf(text, sizeof text, "%.2f s", ns / 1e9);
+    return text;
+}
+
+inline std::string format_bytes(double bytes) {
+    char text[32];
+    if (bytes < 1024) std::snprintf(text, sizeof text, "%.0f B", bytes);
+    else if (bytes < 1024 * 1024) std::snprintf(text, sizeof text, "%.1f KiB", bytes / 1024);
+    else std::snprintf(text, sizeof text, "%.1f MiB", bytes / (1024 * 1024));
+    return text;
+}
+
+// Clocks and allocator counters at one point in time; subtract two to measure what happened in between.
+struct Snapshot {
+    std::int64_t wallNs;
+    std::int64_t cpuNs;
+    std::uint64_t allocations;
+    std::uint64_t allocated;
+
+    static Snapshot take(const lua_allocator::Allocator& allocator) {
+        const lua_allocator::Stats& stats = allocator.stats();
+        return {curling::detail::steadyNowNs(), cpu_now_ns(), stats.allocations, stats.allocated};
+    }
+};
+
+inline sol::protected_function compile(sol::state& lua, const std::string& code) {
+    sol::load_result chunk = lua.load(code, "=(bench)");
+    if (!chunk.valid()) {
+        sol::error err = chunk;
+        throw curling::LogicException(err.what());
+    }
+    return chunk.get<sol::protected_function>();
+}
+
+// Nearest-rank percentile of sorted samples.
+inline std::int64_t percentile(const std::vector<std::int64_t>& sorted, double p) {
+    size_t rank = static_cast<size_t>(p / 100 * static_cast<double>(sorted.size()) + 0.999999);
+    return sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1];
+}
+
+// :time <lua> — runs the chunk once.
+inline void time_chunk(sol::state& lua, const lua_allocator::Allocator& allocator, const std::string& code) {
+    if (code.empty()) {
+        std::cerr << "usage: :time <lua>\n";
+        return;
+    }
+    try {
+        sol::protected_function fn = compile(lua, code);
+        const size_t liveBefore = allocator.stats().live;
+        const Snapshot start = Snapshot::take(allocator);
+        sol::protected_function_result res = fn();
+        const Snapshot end = Snapshot::take(allocator);
+        if (!res.valid()) {
+            sol::error err = res;
+            std::cerr << "Lua error: " << err.what() << '\n';
+        }
+        const double liveDelta = static_cast<double>(allocator.stats().live) - static_cast<double>(liveBefore);
+        std::cout << "wall " << format_duration(static_cast<double>(end.wallNs - start.wallNs))
+                  << ", cpu " << format_duration(static_cast<double>(end.cpuNs - start.cpuNs))
+                  << ", " << (end.allocations - start.allocations) << " allocations, "
+                  << format_bytes(static_cast<double>(end.allocated - start.allocated)) << " allocated ("
+                  << (liveDelta < 0 ? "-" : "+") << format_bytes(liveDelta < 0 ? -liveDelta : liveDelta)
+                  << " live)\n";
+    } catch (const std::exception& e) {
+        std::cerr << "Lua error: " << e.what() << '\n';
+    }
+}
+
+// Latencies of up to `concurrency` runs in flight at once. Each run gets a function as `...`
+// to call when it has finished, typically from a sendAsync callback; runs are started as
+// others finish, and the event loop is driven in between.
+// The state is shared with the done functions, since Lua may keep them past the benchmark.
+struct Flight {
+    std::vector<std::int64_t> startNs;
+    std::vector<std::int64_t> latencyNs;
+    size_t finished = 0;
+};
+
+inline bool run_concurrent(sol::state& lua, sol::protected_function& fn, size_t runs, size_t concurrency,
+                           std::vector<std::int64_t>& latencies) {
+    auto flight = std::make_shared<Flight>();
+    flight->startNs.assign(runs, 0);
+    flight->latencyNs.assign(runs, -1);
+    size_t started = 0;
+    while (flight->finished < runs) {
+        if (repl::g_got_sigint) return false;
+        while (started < runs && started - flight->finished < concurrency) {
+            const size_t run = started++;
+            auto done = [flight, run] {
+                if (flight->latencyNs[run] >= 0) return;
+                flight->latencyNs[run] = curling::detail::steadyNowNs() - flight->startNs[run];
+                ++flight->finished;
+            };
+            flight->startNs[run] = curling::detail::steadyNowNs();
+            sol::protected_function_result res = fn(sol::make_object(lua, done));
+            if (!res.valid()) {
+                sol::error err = res;
+                std::cerr << "Lua error: " << err.what() << '\n';
+                return false;
+            }
+        }
+        if (flight->finished == runs) break;
+        if (curling::pending() == 0 && curling::ready() == 0) {
+            std::cerr << "bench: " << (started - flight->finished)
+                      << " runs are unfinished with no request pending; call the function passed as ... when a run is done\n";
+            return false;
+        }
+        curling::poll(100);
+        curling::dispatch();
+    }
+    latencies = flight->latencyNs;
+    return true;
+}
+
+// :bench N [-c C] <lua> — runs the chunk N times, one after the other or C at a time.
+inline void bench_chunk(sol::state& lua, const lua_allocator::Allocator& allocator, const std::string& args) {
+    std::istringstream in(args);
+    long runs = 0;
+    long concurrency = 1;
+    std::string option;
+    in >> runs;
+    std::streampos codeStart = in.tellg();
+    if (in >> option && option == "-c") {
+        in >> concurrency;
+        codeStart = in.tellg();
+    }
+    std::string code = in && codeStart != std::streampos(-1) ? args.substr(static_cast<size_t>(codeStart)) : "";
+    code.erase(0, code.find_first_not_of(' '));
+    if (runs <= 0 || concurrency <= 0 || code.empty()) {
+        std::cerr << "usage: :bench N [-c C] <lua>\n"
+                  << "  with -c, up to C runs are in flight; each must call the function passed as ... when done\n";
+        return;
+    }
+
+    try {
+        sol::protected_function fn = compile(lua, code);
+        repl::g_got_sigint = 0;
+        std::vector<std::int64_t> latencies;
+        const Snapshot start = Snapshot::take(allocator);
+        bool completed = true;
+        if (concurrency > 1) {
+            completed = run_concurrent(lua, fn, static_cast<size_t>(runs), static_cast<size_t>(concurrency), latencies);
+        } else {
+            latencies.reserve(static_cast<size_t>(runs));
+            for (long i = 0; i < runs && completed; ++i) {
+                const std::int64_t runStart = curling::detail::steadyNowNs();
+                sol::protected_function_result res = fn();
+                latencies.push_back(curling::detail::steadyNowNs() - runStart);
+                if (!res.valid()) {
+                    sol::error err = res;
+                    std::cerr << "Lua error: " << err.what() << '\n';
+                    completed = false;
+                }
+                if (repl::g_got_sigint) completed = false;
+            }
+        }
+        const Snapshot end = Snapshot::take(allocator);
+        if (!completed) {
+            std::cerr << "bench: stopped before all runs finished\n";
+            return;
+        }
+
+        std::sort(latencies.begin(), latencies.end());
+        const double n = static_cast<double>(runs);
+        const double wall = static_cast<double>(end.wallNs - start.wallNs);
+        char rate[32];
+        std::snprintf(rate, sizeof rate, "%.1f", n / (wall / 1e9));
+        std::cout << runs << " runs in " << format_duration(wall) << " (" << rate << "/s"
+                  << (concurrency > 1 ? ", " + std::to_string(concurrency) + " at a time" : std::string()) << ")\n"
+                  << "latency min " << format_duration(static_cast<double>(latencies.front()))
+                  << ", p50 " << format_duration(static_cast<double>(percentile(latencies, 50)))
+                  << ", p99 " << format_duration(static_cast<double>(percentile(latencies, 99)))
+                  << ", max " << format_duration(static_cast<double>(latencies.back())) << "\n"
+                  << "per run: cpu " << format_duration(static_cast<double>(end.cpuNs - start.cpuNs) / n) << ", "
+                  << static_cast<double>(end.allocations - start.allocations) / n << " allocations, "
+                  << format_bytes(static_cast<double>(end.allocated - start.allocated) / n) << " allocated\n";
+    } catch (const std::exception& e) {
+        std::cerr << "Lua error: " << e.what() << '\n';
+    }
+}
+
+} // namespace bench
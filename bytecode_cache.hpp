@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <lua.hpp>
+#include "curling.hpp"
+
+namespace bytecode_cache {
+
+// === On-disk cache of compiled scripts ===
+// An entry is named after a hash of everything that affects the bytecode: the Lua release,
+// the chunk name (kept in the debug info) and the source. Editing the script changes the
+// key, so stale entries are never read; they are just left behind.
+// An entry starts with a header line holding the hash of the bytecode, checked before
+// loading, because Lua does not verify bytecode and a damaged file could crash it.
+// XXH64 rather than SHA-256: hashing must stay well below the cost of compiling, and
+// 64 bits are plenty to tell apart versions of the scripts run on one machine.
+// Entries are written to a private temporary file and renamed into place, so concurrent
+// processes only ever see complete entries.
+
+inline const char* magic = "curling-bytecode 1 ";
+
+inline std::string hash(std::string_view data) {
+    curling::detail::XxHash64 hasher;
+    hasher.update(reinterpret_cast<const unsigned char*>(data.data()), data.size());
+    return hasher.hex();
+}
+
+inline bool read_file(const std::string& path, std::string& out) {
+    FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file) return false;
+    char chunk[65536];
+    size_t n;
+    out.clear();
+    while ((n = std::fread(chunk, 1, sizeof(chunk), file)) > 0) out.append(chunk, n);
+    bool ok = !std::ferror(file);
+    std::fclose(file);
+    return ok;
+}
+
+inline int dump_writer(lua_State*, const void* p, size_t size, void* ud) {
+    static_cast<std::string*>(ud)->append(static_cast<const char*>(p), size);
+    return 0;
+}
+
+// Writes the entry through a temporary file and rename(); failures only cost the cache.
+inline void store(const std::string& dir, const std::string& entry, const std::string& bytecode) {
+    ::mkdir(dir.c_str(), 0755);
+    std::string tmp = entry + "." + std::to_string(::getpid()) + ".tmp";
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return;
+    std::string data = magic + hash(bytecode) + "\n" + bytecode;
+    const char* p = data.data();
+    size_t left = data.size();
+    while (left > 0) {
+        ssize_t n = ::write(fd, p, left);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        p += n;
+        left -= static_cast<size_t>(n);
+    }
+    bool ok = left == 0 && ::close(fd) == 0;
+    if (!ok || std::rename(tmp.c_str(), entry.c_str()) != 0) std::remove(tmp.c_str());
+}
+
+// Loads a script like luaL_loadfilex(L, path, nullptr), going through the cache in dir.
+// Precompiled chunks (luac output) are loaded as they are, since there is nothing to cache.
+// Pushes the compiled chunk, or an error message, and returns the load status.
+inline int load_file(lua_State* L, const std::string& path, const std::string& dir) {
+    std::string source;
+    if (!read_file(path, source)) {
+        lua_pushfstring(L, "cannot open %s: %s", path.c_str(), std::strerror(errno));
+        return LUA_ERRFILE;
+    }
+    if (!source.empty() && source[0] == '#') {
+        source.erase(0, source.find('\n')); // shebang line; keep the line numbers
+        if (source.size() > 1 && source[1] == LUA_SIGNATURE[0]) source.erase(0, 1); // unless it precedes bytecode
+    }
+    const std::string chunkname = "@" + path;
+    if (!source.empty() && source[0] == LUA_SIGNATURE[0]) {
+        return luaL_loadbufferx(L, source.data(), source.size(), chunkname.c_str(), "b");
+    }
+    const std::string key = hash(std::string(LUA_RELEASE) + '\0' + chunkname + '\0' + source);
+    const std::string entry = dir + "/" + key + ".luac";
+
+    std::string cached;
+    if (read_file(entry, cached)) {
+        size_t header = cached.find('\n');
+        const size_t magicLength = std::char_traits<char>::length(magic);
+        std::string_view bytecode = header == std::string::npos ? std::string_view()
+                                                                 : std::string_view(cached).substr(header + 1);
+        if (header != std::string::npos && cached.compare(0, magicLength, magic) == 0 &&
+            cached.compare(magicLength, header - magicLength, hash(bytecode)) == 0) {
+            if (luaL_loadbufferx(L, bytecode.data(), bytecode.size(), chunkname.c_str(), "b") == LUA_OK) {
+                return LUA_OK;
+            }
+            lua_pop(L, 1); // e.g. written by another Lua build: recompile and replace it
+        }
+    }
+
+    int status = luaL_loadbufferx(L, source.data(), source.size(), chunkname.c_str(), "t");
+    if (status != LUA_OK) return status;
+    std::string bytecode;
+    if (lua_dump(L, dump_writer, &bytecode, 0) == 0) store(dir, entry, bytecode);
+    return LUA_OK;
+}
+
+} // namespace bytecode_cache
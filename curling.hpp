@@ -61,6 +61,7 @@
 
 #pragma once
 #include <string>
+#include <string_view>
 #include <map>
 #include <vector>
 #include <sstream>
@@ -74,6 +75,35 @@
 #include <curl/curl.h>
 #include <thread>
 #include <chrono>
+#include <atomic>
+#include <cstdint>
+#include <climits>
+#include <csignal>
+#include <variant>
+#include <cstdio>
+#include <optional>
+#include <deque>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Static tracepoints (USDT) for bpftrace, perf and SystemTap: define CURLING_USDT and have
+// <sys/sdt.h> (systemtap-sdt-dev). Otherwise the probes and their arguments compile to nothing.
+#if defined(CURLING_USDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define CURLING_HAVE_USDT 1
+#endif
+#endif
+
+#ifdef CURLING_HAVE_USDT
+#define CURLING_PROBE(name, ...) STAP_PROBEV(curling, name, __VA_ARGS__)
+#else
+#define CURLING_PROBE(name, ...) ((void)0)
+#endif
 
 
 namespace curling {
@@ -156,110 +186,1889 @@ public:
     explicit MimeException(const std::string& msg) : CurlingException(msg) {}
 };
 
+/** @class CircuitOpenException
+ * @brief Thrown without contacting the server when the origin's circuit breaker is open.
+ */
+class CircuitOpenException : public RequestException {
+public:
+    explicit CircuitOpenException(const std::string& msg) : RequestException(msg) {}
+};
+
 /** @class LogicException
  * @brief Thrown when library logic prohibits an operation.
  */
-class LogicException : public CurlingException {
+class LogicException : public CurlingException {
+public:
+    explicit LogicException(const std::string& msg) : CurlingException(msg) {}
+};
+
+inline constexpr int version_major = 1;
+inline constexpr int version_minor = 2;
+inline constexpr int version_patch = 0;
+
+inline std::string version() {
+    std::ostringstream oss;
+    oss << version_major << '.' << version_minor << '.' << version_patch;
+    return oss.str();
+}
+
+/**
+ * @brief Util/helper section
+ * @note meant for internal library use only
+ */
+namespace detail {
+
+inline std::once_flag curlGlobalInitFlag;
+inline std::mutex curlGlobalMutex;
+
+inline int instanceCount = 0;
+
+inline void ensureCurlGlobalInit() {
+    std::lock_guard<std::mutex> lock(curlGlobalMutex);
+    if (instanceCount++ == 0) {
+        if (curl_global_init(CURL_GLOBAL_DEFAULT) != CURLE_OK) {
+            throw InitializationException("Failed to initialize libcurl globally");
+        }
+    }
+}
+
+inline void maybeCleanupGlobalCurl() noexcept {
+    std::lock_guard<std::mutex> lock(curlGlobalMutex);
+    if (--instanceCount == 0) {
+        curl_global_cleanup();
+    }
+}
+
+inline void trim(std::string& s) {
+    s.erase(s.begin(), std::find_if(s.begin(), s.end(), [](unsigned char ch){
+        return !std::isspace(ch);
+    }));
+    s.erase(std::find_if(s.rbegin(), s.rend(), [](unsigned char ch){
+        return !std::isspace(ch);
+    }).base(), s.end());
+}
+
+inline void toLowerCase(std::string& s) {
+    std::transform(s.begin(), s.end(), s.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+}
+
+
+inline size_t HeaderCallback(char* buffer, size_t size, size_t nitems, void* userdata) {
+    auto* headerMap = static_cast<std::map<std::string, std::vector<std::string>>*>(userdata);
+    std::string headerLine(buffer, size * nitems);
+
+    if (headerLine.empty()) return 0; // skip the separation line
+
+    auto colonPos = headerLine.find(":");
+    if (colonPos != std::string::npos) {
+        std::string key = headerLine.substr(0, colonPos);
+        std::string value = headerLine.substr(colonPos + 1);
+        detail::trim(key);
+        detail::trim(value);
+        detail::toLowerCase(key);
+        (*headerMap)[key].push_back(value);
+    }
+
+    return size * nitems;
+}
+
+inline int ProgressCallbackBridge(void* clientp, curl_off_t dltotal, curl_off_t dlnow,
+                                  curl_off_t ultotal, curl_off_t ulnow);
+
+/**
+ * @brief Extracts the lowercase host name of a URL, or an empty string if it cannot be parsed.
+ */
+inline std::string urlHost(const std::string& url) {
+    std::string host;
+    CURLU* handle = curl_url();
+    if (!handle) return host;
+    if (curl_url_set(handle, CURLUPART_URL, url.c_str(), CURLU_DEFAULT_SCHEME) == CURLUE_OK) {
+        char* part = nullptr;
+        if (curl_url_get(handle, CURLUPART_HOST, &part, 0) == CURLUE_OK && part) {
+            host = part;
+            toLowerCase(host);
+        }
+        curl_free(part);
+    }
+    curl_url_cleanup(handle);
+    return host;
+}
+
+/**
+ * @brief Returns the lowercase "scheme://host:port" origin of a URL, or an empty string if it cannot be parsed.
+ */
+inline std::string urlOrigin(const std::string& url) {
+    std::string origin;
+    CURLU* handle = curl_url();
+    if (!handle) return origin;
+    if (curl_url_set(handle, CURLUPART_URL, url.c_str(), CURLU_DEFAULT_SCHEME) == CURLUE_OK) {
+        char* scheme = nullptr;
+        char* host = nullptr;
+        char* port = nullptr;
+        if (curl_url_get(handle, CURLUPART_SCHEME, &scheme, 0) == CURLUE_OK &&
+            curl_url_get(handle, CURLUPART_HOST, &host, 0) == CURLUE_OK &&
+            curl_url_get(handle, CURLUPART_PORT, &port, CURLU_DEFAULT_PORT) == CURLUE_OK) {
+            origin = std::string(scheme) + "://" + host + ":" + port;
+            toLowerCase(origin);
+        }
+        curl_free(scheme);
+        curl_free(host);
+        curl_free(port);
+    }
+    curl_url_cleanup(handle);
+    return origin;
+}
+
+inline std::int64_t steadyNowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline std::atomic<std::int64_t> firstSendNs{0};
+
+}//detail end
+
+/**
+ * @brief steady_clock time (ns since its epoch) at which the first request of the process
+ * started sending, or 0 if none has; used to measure startup latency.
+ */
+inline std::int64_t firstSendTime() {
+    return detail::firstSendNs.load(std::memory_order_relaxed);
+}
+
+/**
+ * @class RateLimiter
+ * @brief Lock-free token bucket, safe to share between threads and requests.
+ *
+ * Implemented with the generic cell rate algorithm: the whole bucket state is a
+ * single atomic "theoretical arrival time", so claiming a token is one CAS loop.
+ * A limiter of rate r and burst b lets b requests through at once, then one every 1/r seconds.
+ */
+class RateLimiter {
+public:
+    /**
+     * @param ratePerSecond Sustained number of requests per second.
+     * @param burst Number of requests allowed back to back when the bucket is full.
+     * @throws LogicException if rate is not positive or burst is zero.
+     */
+    RateLimiter(double ratePerSecond, unsigned burst = 1)
+        : ratePerSecond_(ratePerSecond), burst_(burst), tat_(0) {
+        if (!(ratePerSecond > 0.0) || burst == 0) {
+            throw LogicException("RateLimiter needs a positive rate and a burst of at least 1");
+        }
+        intervalNs_ = static_cast<std::int64_t>(1e9 / ratePerSecond);
+        toleranceNs_ = intervalNs_ * static_cast<std::int64_t>(burst - 1);
+    }
+
+    /**
+     * @brief Claims a token without blocking.
+     * @return How long the caller must wait before the claimed slot begins (zero if it may go now).
+     *
+     * Meant for schedulers that delay a transfer instead of sleeping a thread.
+     */
+    std::chrono::nanoseconds reserve() {
+        std::int64_t now = detail::steadyNowNs();
+        std::int64_t old = tat_.load(std::memory_order_relaxed);
+        std::int64_t next;
+        do {
+            next = std::max(old, now) + intervalNs_;
+        } while (!tat_.compare_exchange_weak(old, next, std::memory_order_acq_rel, std::memory_order_relaxed));
+        return std::chrono::nanoseconds(std::max<std::int64_t>(0, old - toleranceNs_ - now));
+    }
+
+    /**
+     * @brief Claims a token only if one is available right now.
+     * @return True if the token was taken.
+     */
+    bool tryAcquire() {
+        std::int64_t now = detail::steadyNowNs();
+        std::int64_t old = tat_.load(std::memory_order_relaxed);
+        do {
+            if (old - toleranceNs_ > now) return false;
+        } while (!tat_.compare_exchange_weak(old, std::max(old, now) + intervalNs_,
+                                             std::memory_order_acq_rel, std::memory_order_relaxed));
+        return true;
+    }
+
+    /**
+     * @brief Claims a token, sleeping the calling thread until its slot begins.
+     */
+    void acquire() {
+        auto wait = reserve();
+        if (wait.count() > 0) std::this_thread::sleep_for(wait);
+    }
+
+    double rate() const { return ratePerSecond_; }
+    unsigned burst() const { return burst_; }
+
+private:
+    double ratePerSecond_;
+    unsigned burst_;
+    std::int64_t intervalNs_;
+    std::int64_t toleranceNs_;
+    std::atomic<std::int64_t> tat_;
+};
+
+namespace detail {
+
+inline std::mutex rateLimiterMutex;
+inline std::map<std::string, std::shared_ptr<RateLimiter>> rateLimiters;
+inline std::atomic<bool> hasRateLimiters{false};
+
+} // namespace detail
+
+/**
+ * @brief Creates (or replaces) a process-wide named rate limiter.
+ *
+ * A request is throttled by the limiter named after its explicit key (Request::setRateLimitKey)
+ * or, failing that, by the limiter named after its URL host, e.g. "api.example.com".
+ * @return The new limiter.
+ */
+inline std::shared_ptr<RateLimiter> defineRateLimiter(const std::string& name, double ratePerSecond, unsigned burst = 1) {
+    auto limiter = std::make_shared<RateLimiter>(ratePerSecond, burst);
+    std::lock_guard<std::mutex> lock(detail::rateLimiterMutex);
+    detail::rateLimiters[name] = limiter;
+    detail::hasRateLimiters = true;
+    return limiter;
+}
+
+/**
+ * @brief Looks up a named rate limiter.
+ * @return The limiter, or nullptr if none is registered under that name.
+ */
+inline std::shared_ptr<RateLimiter> findRateLimiter(const std::string& name) {
+    if (!detail::hasRateLimiters) return nullptr;
+    std::lock_guard<std::mutex> lock(detail::rateLimiterMutex);
+    auto it = detail::rateLimiters.find(name);
+    return it != detail::rateLimiters.end() ? it->second : nullptr;
+}
+
+/**
+ * @brief Removes a named rate limiter. Requests already holding it keep their reference.
+ */
+inline void removeRateLimiter(const std::string& name) {
+    std::lock_guard<std::mutex> lock(detail::rateLimiterMutex);
+    detail::rateLimiters.erase(name);
+    detail::hasRateLimiters = !detail::rateLimiters.empty();
+}
+
+/**
+ * @struct CircuitBreakerConfig
+ * @brief Thresholds and timings of a CircuitBreaker.
+ */
+struct CircuitBreakerConfig {
+    double failureRateThreshold = 0.5;               ///< Failure ratio (0..1] that trips the breaker.
+    unsigned minimumCalls = 10;                      ///< Calls needed in the window before tripping.
+    unsigned windowSize = 20;                        ///< Number of recent calls considered.
+    std::chrono::milliseconds openDuration{30000};   ///< Time spent OPEN before probing.
+    unsigned halfOpenProbes = 1;                     ///< Concurrent probe requests while HALF_OPEN.
+    bool countServerErrors = true;                   ///< Count HTTP 5xx responses as failures.
+};
+
+/**
+ * @class CircuitBreaker
+ * @brief Fails requests to an unhealthy origin fast instead of waiting on timeouts.
+ *
+ * CLOSED: requests flow, outcomes are recorded in a sliding window of the last
+ * windowSize calls. Once at least minimumCalls are recorded and the failure rate
+ * reaches failureRateThreshold the breaker trips to OPEN.
+ * OPEN: requests are rejected with CircuitOpenException until openDuration elapses.
+ * HALF_OPEN: up to halfOpenProbes requests are let through; a success closes the
+ * breaker again, a failure re-opens it.
+ *
+ * Thread-safe; one breaker is shared by every request to the same origin.
+ */
+class CircuitBreaker {
+public:
+    enum class State {
+        CLOSED,
+        OPEN,
+        HALF_OPEN
+    };
+
+    using Config = CircuitBreakerConfig;
+
+    explicit CircuitBreaker(Config config = Config())
+        : config_(config), window_(std::max(1u, config.windowSize), false) {
+        if (!(config.failureRateThreshold > 0.0) || config.failureRateThreshold > 1.0 || config.halfOpenProbes == 0) {
+            throw LogicException("CircuitBreaker needs a failure threshold in (0, 1] and at least one probe");
+        }
+    }
+
+    /**
+     * @brief Asks for permission to send one request.
+     * @return False if the breaker is open. When true, the caller must report
+     * the outcome through recordSuccess() or recordFailure(), or give the
+     * permission back with releaseRequest() if the request is never sent.
+     */
+    bool allowRequest() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (state_ == State::OPEN) {
+            if (std::chrono::steady_clock::now() < openedAt_ + config_.openDuration) return false;
+            state_ = State::HALF_OPEN;
+            probesInFlight_ = 0;
+        }
+        if (state_ == State::HALF_OPEN) {
+            if (probesInFlight_ >= config_.halfOpenProbes) return false;
+            ++probesInFlight_;
+        }
+        return true;
+    }
+
+    void recordSuccess() { record(false); }
+    void recordFailure() { record(true); }
+
+    /**
+     * @brief Gives back a permission whose request was cancelled or never sent.
+     * No outcome is recorded, so a half-open breaker can let another probe through.
+     */
+    void releaseRequest() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (state_ == State::HALF_OPEN && probesInFlight_ > 0) --probesInFlight_;
+    }
+
+    /**
+     * @brief Reports the outcome of a transfer according to the breaker's configuration.
+     */
+    void recordOutcome(CURLcode code, long httpCode) {
+        record(code != CURLE_OK || (config_.countServerErrors && httpCode >= 500));
+    }
+
+    State state() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return state_;
+    }
+
+    const Config& config() const { return config_; }
+
+    /**
+     * @brief Forces the breaker back to CLOSED with an empty window.
+     */
+    void reset() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        close();
+    }
+
+private:
+    Config config_;
+    mutable std::mutex mutex_;
+    State state_ = State::CLOSED;
+    std::vector<bool> window_;
+    size_t next_ = 0;
+    unsigned calls_ = 0;
+    unsigned failures_ = 0;
+    unsigned probesInFlight_ = 0;
+    std::chrono::steady_clock::time_point openedAt_;
+
+    void record(bool failed) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (state_ == State::HALF_OPEN) {
+            if (probesInFlight_ > 0) --probesInFlight_;
+            if (failed) trip();
+            else close();
+            return;
+        }
+        if (state_ == State::OPEN) return; // late result of a request sent before tripping
+
+        if (calls_ == window_.size()) {
+            if (window_[next_]) --failures_;
+        } else {
+            ++calls_;
+        }
+        window_[next_] = failed;
+        next_ = (next_ + 1) % window_.size();
+        if (failed) ++failures_;
+
+        if (calls_ >= config_.minimumCalls &&
+            static_cast<double>(failures_) >= config_.failureRateThreshold * calls_) {
+            trip();
+        }
+    }
+
+    void trip() {
+        state_ = State::OPEN;
+        openedAt_ = std::chrono::steady_clock::now();
+        probesInFlight_ = 0;
+    }
+
+    void close() {
+        state_ = State::CLOSED;
+        std::fill(window_.begin(), window_.end(), false);
+        next_ = calls_ = failures_ = probesInFlight_ = 0;
+    }
+};
+
+namespace detail {
+
+inline std::mutex circuitBreakerMutex;
+inline std::map<std::string, std::shared_ptr<CircuitBreaker>> circuitBreakers;
+inline std::unique_ptr<CircuitBreaker::Config> circuitBreakerDefaults;
+inline std::atomic<bool> hasCircuitBreakers{false};
+
+} // namespace detail
+
+/**
+ * @brief Installs (or replaces) the circuit breaker of one origin, e.g. "https://api.example.com:443".
+ * @param origin A URL or origin; it is normalized to scheme://host:port.
+ * @return The new breaker.
+ */
+inline std::shared_ptr<CircuitBreaker> configureCircuitBreaker(const std::string& origin,
+                                                               CircuitBreaker::Config config = CircuitBreaker::Config()) {
+    auto breaker = std::make_shared<CircuitBreaker>(config);
+    std::string key = detail::urlOrigin(origin);
+    std::lock_guard<std::mutex> lock(detail::circuitBreakerMutex);
+    detail::circuitBreakers[key.empty() ? origin : key] = breaker;
+    detail::hasCircuitBreakers = true;
+    return breaker;
+}
+
+/**
+ * @brief Gives every origin without an explicit breaker one created on first use with this configuration.
+ */
+inline void enableCircuitBreakers(CircuitBreaker::Config config = CircuitBreaker::Config()) {
+    CircuitBreaker validate(config); // throws on an invalid configuration
+    std::lock_guard<std::mutex> lock(detail::circuitBreakerMutex);
+    detail::circuitBreakerDefaults = std::make_unique<CircuitBreaker::Config>(config);
+    detail::hasCircuitBreakers = true;
+}
+
+/**
+ * @brief Removes every circuit breaker and the default configuration.
+ */
+inline void disableCircuitBreakers() {
+    std::lock_guard<std::mutex> lock(detail::circuitBreakerMutex);
+    detail::circuitBreakers.clear();
+    detail::circuitBreakerDefaults.reset();
+    detail::hasCircuitBreakers = false;
+}
+
+/**
+ * @brief Returns the breaker guarding a URL's origin, creating it from the defaults if enabled.
+ * @return The breaker, or nullptr if the origin is not guarded.
+ */
+inline std::shared_ptr<CircuitBreaker> findCircuitBreaker(const std::string& url) {
+    if (!detail::hasCircuitBreakers) return nullptr;
+    std::string key = detail::urlOrigin(url);
+    if (key.empty()) key = url;
+    std::lock_guard<std::mutex> lock(detail::circuitBreakerMutex);
+    auto it = detail::circuitBreakers.find(key);
+    if (it != detail::circuitBreakers.end()) return it->second;
+    if (!detail::circuitBreakerDefaults) return nullptr;
+    auto breaker = std::make_shared<CircuitBreaker>(*detail::circuitBreakerDefaults);
+    detail::circuitBreakers.emplace(key, breaker);
+    return breaker;
+}
+
+
+
+/** SAFETY: RAII deleters for CURL handles */
+struct CurlHandleDeleter { void operator()(CURL* h) const noexcept { if (h) curl_easy_cleanup(h); }};
+struct CurlSlistDeleter { void operator()(curl_slist* l) const noexcept { if (l) curl_slist_free_all(l); }};
+struct CurlMimeDeleter { void operator()(curl_mime* m) const noexcept { if (m) curl_mime_free(m); }};
+struct FileCloser { void operator()(FILE* file) const noexcept { if (file) std::fclose(file); }};
+struct CurlMultiDeleter { void operator()(CURLM* m) const noexcept { if (m) curl_multi_cleanup(m); }};
+
+using CurlPtr = std::unique_ptr<CURL, CurlHandleDeleter>;
+using CurlSlistPtr = std::unique_ptr<curl_slist, CurlSlistDeleter>;
+using CurlMimePtr = std::unique_ptr<curl_mime, CurlMimeDeleter>;
+using FilePtr = std::unique_ptr<FILE, FileCloser>;
+using CurlMultiPtr = std::unique_ptr<CURLM, CurlMultiDeleter>;
+
+/**
+ * @brief Work to run while a request waits on the network, e.g. a garbage collector step.
+ *
+ * Called on the sending thread each time a wait slice passes without socket activity.
+ * It should do a small, bounded amount of work and return false once it has nothing left
+ * to do for the current wait.
+ */
+using IdleHook = std::function<bool()>;
+
+namespace detail {
+
+inline thread_local IdleHook idleHook;
+constexpr long idleSliceMs = 5; ///< wait slice between idle hook calls
+
+} // namespace detail
+
+/**
+ * @brief Installs the idle hook of the calling thread; nullptr removes it.
+ */
+inline void setIdleHook(IdleHook hook) {
+    detail::idleHook = std::move(hook);
+}
+
+/**
+ * @brief What a thread is blocked on inside curling, for samplers such as a profiler.
+ */
+enum class Blocked : int {
+    None,
+    Transfer,  ///< a synchronous transfer
+    Backoff,   ///< the delay before a retry
+    RateLimit, ///< waiting for a rate limiter token
+    Poll,      ///< poll(): async transfers or the caller's fd
+    Idle       ///< set by the application, e.g. a REPL waiting for input
+};
+
+namespace detail {
+
+/// Blocked value of each thread; a volatile sig_atomic_t so a signal handler on the thread can read it.
+inline thread_local volatile std::sig_atomic_t blockedOn = 0;
+
+/// Marks the calling thread as blocked for its lifetime, unless an outer scope already did.
+class BlockedScope {
+public:
+    explicit BlockedScope(Blocked what) : outer_(blockedOn) {
+        if (outer_ == 0) blockedOn = static_cast<std::sig_atomic_t>(what);
+    }
+    ~BlockedScope() { blockedOn = outer_; }
+
+    BlockedScope(const BlockedScope&) = delete;
+    BlockedScope& operator=(const BlockedScope&) = delete;
+
+private:
+    std::sig_atomic_t outer_;
+};
+
+} // namespace detail
+
+/**
+ * @class ConnectionCache
+ * @brief Open connections, DNS answers and TLS sessions kept between Requests.
+ *
+ * Each Request owns its easy handle, so without a cache its connections close with it.
+ * Requests created while a cache is installed on their thread share it and reuse its
+ * connections. libcurl does not support sharing connections between concurrent threads,
+ * so a cache must only be used from one thread at a time.
+ */
+class ConnectionCache {
+public:
+    ConnectionCache() {
+        detail::ensureCurlGlobalInit(); // keeps libcurl initialized between Requests too
+        handle = curl_share_init();
+        if (!handle) {
+            detail::maybeCleanupGlobalCurl();
+            throw InitializationException("Failed to create a curl share handle");
+        }
+        curl_share_setopt(handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+        curl_share_setopt(handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+        curl_share_setopt(handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    }
+    ~ConnectionCache() noexcept {
+        curl_share_cleanup(handle);
+        detail::maybeCleanupGlobalCurl();
+    }
+
+    ConnectionCache(const ConnectionCache&) = delete;
+    ConnectionCache& operator=(const ConnectionCache&) = delete;
+
+    CURLSH* get() const { return handle; }
+
+private:
+    CURLSH* handle = nullptr;
+};
+
+namespace detail {
+inline thread_local std::shared_ptr<ConnectionCache> connectionCache;
+}
+
+/**
+ * @brief Installs the connection cache used by Requests created on the calling thread; nullptr removes it.
+ */
+inline void setConnectionCache(std::shared_ptr<ConnectionCache> cache) {
+    detail::connectionCache = std::move(cache);
+}
+
+namespace detail {
+
+/**
+ * @brief Appends one header line to a curl_slist owned by a CurlSlistPtr.
+ * @throws HeaderException if libcurl cannot allocate the entry.
+ */
+inline void appendHeader(CurlSlistPtr& list, const std::string& header) {
+    auto newList = curl_slist_append(list.get(), header.c_str());
+    if(!newList){
+        throw HeaderException("Failed to append header to curl_slist");
+    }
+    list.release(); //release is needed here to avoid double free, as newList will contain this old pointer somewhere down the list chain
+    list.reset(newList);
+}
+
+/**
+ * Download state for Request::setResume(). The partial file is kept next to a
+ * "<file>.curling" sidecar recording the URL and the validator (ETag or
+ * Last-Modified) it was fetched under, so a later process can continue it.
+ */
+struct ResumeState {
+    std::string sidecarPath;
+    std::string url;
+    std::string validator;     ///< sent as If-Range; empty means the file cannot be resumed
+    FILE* file = nullptr;
+    CURL* handle = nullptr;
+    const std::map<std::string, std::vector<std::string>>* headers = nullptr;
+    curl_off_t offset = 0;     ///< byte offset requested by the current attempt
+    long status = 0;           ///< status of the current attempt, 0 until the body starts
+    CurlSlistPtr requestHeaders;
+};
+
+inline std::string lastHeader(const std::map<std::string, std::vector<std::string>>& headers, const std::string& key) {
+    auto it = headers.find(key);
+    return (it != headers.end() && !it->second.empty()) ? it->second.back() : std::string();
+}
+
+// Parses a Content-Range value, "bytes first-last/total" or "bytes */total".
+// first is -1 for the unsatisfied form, total is -1 when the length is "*".
+inline bool parseContentRange(const std::string& value, curl_off_t& first, curl_off_t& total) {
+    std::string unit = value.substr(0, 6);
+    toLowerCase(unit);
+    if (unit != "bytes ") return false;
+    const char* p = value.c_str() + 6;
+    char* end = nullptr;
+    first = -1;
+    if (*p == '*') {
+        ++p;
+    } else {
+        first = std::strtoll(p, &end, 10);
+        if (end == p || *end != '-') return false;
+        p = end + 1;
+        curl_off_t last = std::strtoll(p, &end, 10);
+        if (end == p || last < first) return false;
+        p = end;
+    }
+    if (*p++ != '/') return false;
+    if (*p == '*') {
+        total = -1;
+        return p[1] == '\0' && first >= 0;
+    }
+    total = std::strtoll(p, &end, 10);
+    return end != p && *end == '\0';
+}
+
+// A 416 to "Range: bytes=N-" with "Content-Range: bytes */N": the file on disk is already complete.
+inline bool resumeAlreadyComplete(const ResumeState& state, long httpCode) {
+    curl_off_t first = -1, total = -1;
+    return httpCode == 416 && state.offset > 0 &&
+           parseContentRange(lastHeader(*state.headers, "content-range"), first, total) &&
+           first < 0 && total == state.offset;
+}
+
+inline bool readResumeSidecar(const std::string& path, std::string& url, std::string& validator) {
+    FilePtr file(std::fopen(path.c_str(), "rb"));
+    if (!file) return false;
+    std::string content;
+    char buf[4096];
+    size_t n;
+    while ((n = std::fread(buf, 1, sizeof(buf), file.get())) > 0) content.append(buf, n);
+
+    std::istringstream lines(content);
+    std::string line;
+    if (!std::getline(lines, line) || line != "curling-resume 1") return false;
+    while (std::getline(lines, line)) {
+        auto space = line.find(' ');
+        if (space == std::string::npos) continue;
+        std::string key = line.substr(0, space), value = line.substr(space + 1);
+        if (key == "url") url = value;
+        else if (key == "validator") validator = value;
+    }
+    return !url.empty() && !validator.empty();
+}
+
+inline void writeResumeSidecar(const ResumeState& state) {
+    // write then rename, so a crash never leaves a half-written sidecar
+    std::string tmp = state.sidecarPath + ".tmp";
+    FilePtr file(std::fopen(tmp.c_str(), "wb"));
+    if (!file) return;
+    std::fprintf(file.get(), "curling-resume 1\nurl %s\nvalidator %s\n", state.url.c_str(), state.validator.c_str());
+    if (std::fflush(file.get()) == 0) {
+        file.reset();
+        std::rename(tmp.c_str(), state.sidecarPath.c_str());
+    } else {
+        file.reset();
+        std::remove(tmp.c_str());
+    }
+}
+
+inline size_t ResumeWriteCallback(char* data, size_t size, size_t nmemb, void* userp) {
+    auto* state = static_cast<ResumeState*>(userp);
+    const size_t length = size * nmemb;
+    if (state->status == 0) {
+        curl_easy_getinfo(state->handle, CURLINFO_RESPONSE_CODE, &(state->status));
+        if (state->status == 206) {
+            // the bytes must continue the file exactly; otherwise forget the partial file and start over
+            curl_off_t first = -1, total = -1;
+            if (!parseContentRange(lastHeader(*state->headers, "content-range"), first, total) || first != state->offset) {
+                state->validator.clear();
+                std::remove(state->sidecarPath.c_str());
+                return 0;
+            }
+            if (fseeko(state->file, static_cast<off_t>(state->offset), SEEK_SET) != 0) return 0;
+        } else if (state->status == 200) {
+            // validator mismatch or no range support: the server sent the whole entity again
+            if (::ftruncate(fileno(state->file), 0) != 0 || fseeko(state->file, 0, SEEK_SET) != 0) return 0;
+            state->offset = 0;
+        }
+        if (state->status == 200 || state->status == 206) {
+            // weak ETags cannot be used with If-Range, fall back to Last-Modified
+            std::string etag = lastHeader(*state->headers, "etag");
+            state->validator = (!etag.empty() && etag.rfind("W/", 0) != 0) ? etag : lastHeader(*state->headers, "last-modified");
+            if (!state->validator.empty()) writeResumeSidecar(*state);
+        }
+    }
+    // never let an error page overwrite the partial file
+    if (state->status != 200 && state->status != 206) return length;
+    return std::fwrite(data, 1, length, state->file);
+}
+
+/** Writes one ranged response into its slice of a preallocated file. */
+struct SegmentWriter {
+    int fd;
+    CURL* handle;
+    curl_off_t offset; ///< next file offset to write
+    curl_off_t end;    ///< one past the last byte of the segment
+    bool checked;
+};
+
+inline size_t SegmentWriteCallback(char* data, size_t size, size_t nmemb, void* userp) {
+    auto* writer = static_cast<SegmentWriter*>(userp);
+    const size_t length = size * nmemb;
+    if (!writer->checked) {
+        long code = 0;
+        curl_easy_getinfo(writer->handle, CURLINFO_RESPONSE_CODE, &code);
+        if (code != 206) return 0; // the server ignored the range; never write a full body into a slice
+        writer->checked = true;
+    }
+    if (static_cast<curl_off_t>(length) > writer->end - writer->offset) return 0;
+    size_t done = 0;
+    while (done < length) {
+        ssize_t n = ::pwrite(writer->fd, data + done, length - done, static_cast<off_t>(writer->offset + done));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return 0;
+        }
+        done += static_cast<size_t>(n);
+    }
+    writer->offset += static_cast<curl_off_t>(length);
+    return length;
+}
+
+/**
+ * @brief Reserves size bytes for fd so segments never hit ENOSPC halfway.
+ * @return 0 or an errno value.
+ */
+inline int preallocate(int fd, curl_off_t size) {
+#ifdef __linux__
+    if (::fallocate(fd, 0, 0, static_cast<off_t>(size)) == 0) return 0;
+    if (errno != EOPNOTSUPP && errno != ENOSYS) return errno;
+#else
+    int rc = ::posix_fallocate(fd, 0, static_cast<off_t>(size));
+    if (rc == 0) return 0;
+    if (rc != EINVAL && rc != EOPNOTSUPP) return rc;
+#endif
+    // filesystem without preallocation support: at least size the file
+    return ::ftruncate(fd, static_cast<off_t>(size)) == 0 ? 0 : errno;
+}
+
+} // namespace detail
+
+
+/**
+ * @brief Opt-in tracer recording the request lifecycle as Chrome trace events.
+ *
+ * Events are appended to a per-thread buffer without locking and written out by
+ * flush() as a JSON file that chrome://tracing and ui.perfetto.dev can open.
+ * While tracing is stopped the hooks in Request cost a single relaxed atomic load.
+ */
+namespace trace {
+
+/**
+ * @struct Event
+ * @brief One trace event: a complete span ('X') or an instant ('i').
+ */
+struct Event {
+    std::string name;
+    const char* category;
+    char phase;
+    std::int64_t timestampUs;
+    std::int64_t durationUs;
+    std::string args; ///< JSON object body without braces, e.g. "\"url\":\"...\"".
+};
+
+namespace detail {
+
+/** Fixed-size block of events; the owning thread publishes entries through count. */
+struct Chunk {
+    static constexpr size_t capacity = 1024;
+    Event events[capacity];
+    std::atomic<size_t> count{0};
+    std::atomic<Chunk*> next{nullptr};
+};
+
+/**
+ * Single-producer buffer: only its thread appends, flush() may read concurrently
+ * up to the published count of each chunk.
+ */
+struct ThreadBuffer {
+    explicit ThreadBuffer(unsigned id) : threadId(id), tail(&head) {}
+    ~ThreadBuffer() {
+        Chunk* chunk = head.next.load();
+        while (chunk) {
+            Chunk* next = chunk->next.load();
+            delete chunk;
+            chunk = next;
+        }
+    }
+
+    void append(Event&& event) {
+        size_t n = tail->count.load(std::memory_order_relaxed);
+        if (n == Chunk::capacity) {
+            Chunk* chunk = new Chunk();
+            tail->next.store(chunk, std::memory_order_release);
+            tail = chunk;
+            n = 0;
+        }
+        tail->events[n] = std::move(event);
+        tail->count.store(n + 1, std::memory_order_release);
+    }
+
+    unsigned threadId;
+    Chunk head;
+    Chunk* tail;
+};
+
+inline std::atomic<bool> enabled{false};
+inline std::mutex buffersMutex;
+inline std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+inline const auto epoch = std::chrono::steady_clock::now();
+
+inline ThreadBuffer& localBuffer() {
+    thread_local ThreadBuffer* buffer = nullptr;
+    if (!buffer) {
+        std::lock_guard<std::mutex> lock(buffersMutex);
+        buffers.push_back(std::make_shared<ThreadBuffer>(static_cast<unsigned>(buffers.size() + 1)));
+        buffer = buffers.back().get();
+    }
+    return *buffer;
+}
+
+inline std::string jsonEscape(const std::string& s) {
+    std::string out;
+    out.reserve(s.size());
+    for (unsigned char c : s) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (c < 0x20) {
+                    char buf[8];
+                    std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+                    out += buf;
+                } else {
+                    out += static_cast<char>(c);
+                }
+        }
+    }
+    return out;
+}
+
+} // namespace detail
+
+/** @brief Starts recording events. */
+inline void start() { detail::enabled.store(true, std::memory_order_relaxed); }
+
+/** @brief Stops recording events; already recorded events are kept for flush(). */
+inline void stop() { detail::enabled.store(false, std::memory_order_relaxed); }
+
+inline bool enabled() { return detail::enabled.load(std::memory_order_relaxed); }
+
+/** @brief Microseconds since the trace epoch (process start). */
+inline std::int64_t nowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - detail::epoch).count();
+}
+
+/**
+ * @brief Records a complete span on the calling thread.
+ * @param args JSON object members without the braces, already escaped.
+ */
+inline void complete(const std::string& name, const char* category, std::int64_t startUs,
+                     std::int64_t durationUs, std::string args = "") {
+    if (!enabled()) return;
+    detail::localBuffer().append(Event{name, category, 'X', startUs, durationUs, std::move(args)});
+}
+
+/** @brief Records an instant event on the calling thread. */
+inline void instant(const std::string& name, const char* category, std::string args = "") {
+    if (!enabled()) return;
+    detail::localBuffer().append(Event{name, category, 'i', nowUs(), 0, std::move(args)});
+}
+
+/**
+ * @class Span
+ * @brief RAII helper recording a complete span around a scope.
+ */
+class Span {
+public:
+    Span(std::string name, const char* category)
+        : name(std::move(name)), category(category), startUs(enabled() ? nowUs() : -1) {}
+    ~Span() {
+        if (startUs >= 0) complete(name, category, startUs, nowUs() - startUs, std::move(args));
+    }
+    Span(const Span&) = delete;
+    Span& operator=(const Span&) = delete;
+
+    std::string args;
+
+private:
+    std::string name;
+    const char* category;
+    std::int64_t startUs;
+};
+
+/**
+ * @brief Writes every recorded event to a Chrome trace-event JSON file.
+ * @throws CurlingException if the file cannot be written.
+ */
+inline void flush(const std::string& path) {
+    std::vector<std::shared_ptr<detail::ThreadBuffer>> snapshot;
+    {
+        std::lock_guard<std::mutex> lock(detail::buffersMutex);
+        snapshot = detail::buffers;
+    }
+
+    FilePtr file(std::fopen(path.c_str(), "wb"));
+    if (!file) {
+        throw CurlingException("Failed to open trace file for writing: " + path);
+    }
+    std::fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", file.get());
+    bool first = true;
+    for (const auto& buffer : snapshot) {
+        std::fprintf(file.get(), "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"thread %u\"}}",
+                     first ? "" : ",\n", buffer->threadId, buffer->threadId);
+        first = false;
+        for (const detail::Chunk* chunk = &buffer->head; chunk; chunk = chunk->next.load(std::memory_order_acquire)) {
+            size_t count = chunk->count.load(std::memory_order_acquire);
+            for (size_t i = 0; i < count; ++i) {
+                const Event& e = chunk->events[i];
+                std::fprintf(file.get(), ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\",\"pid\":1,\"tid\":%u,\"ts\":%lld",
+                             detail::jsonEscape(e.name).c_str(), e.category, e.phase, buffer->threadId,
+                             static_cast<long long>(e.timestampUs));
+                if (e.phase == 'X') std::fprintf(file.get(), ",\"dur\":%lld", static_cast<long long>(e.durationUs));
+                if (e.phase == 'i') std::fputs(",\"s\":\"t\"", file.get());
+                std::fprintf(file.get(), ",\"args\":{%s}}", e.args.c_str());
+            }
+        }
+    }
+    std::fputs("\n]}\n", file.get());
+    if (std::fflush(file.get()) != 0) {
+        throw CurlingException("Failed to write trace file: " + path);
+    }
+}
+
+/**
+ * @brief Drops every recorded event.
+ * @warning Only call while no other thread is recording (e.g. after stop()).
+ */
+inline void clear() {
+    std::lock_guard<std::mutex> lock(detail::buffersMutex);
+    for (auto& buffer : detail::buffers) {
+        detail::Chunk* chunk = buffer->head.next.exchange(nullptr);
+        while (chunk) {
+            detail::Chunk* next = chunk->next.load();
+            delete chunk;
+            chunk = next;
+        }
+        buffer->head.count.store(0);
+        buffer->tail = &buffer->head;
+    }
+}
+
+} // namespace trace
+
+/**
+ * @brief Process-wide request metrics with Prometheus text export.
+ *
+ * Every attempt made by Request is counted per origin and status class
+ * ("2xx", "5xx", ... or "error" for transport failures). Each thread records into
+ * its own shard, whose mutex is only ever contended by an exporter.
+ */
+namespace metrics {
+
+/** Upper bounds (seconds) of the latency histogram buckets; +Inf is implicit. */
+inline constexpr double latencyBuckets[] = {0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1.0, 2.5, 5.0, 10.0};
+inline constexpr size_t latencyBucketCount = sizeof(latencyBuckets) / sizeof(latencyBuckets[0]);
+
+namespace detail {
+
+struct Series {
+    std::uint64_t count = 0;
+    double sumSeconds = 0.0;
+    std::uint64_t buckets[latencyBucketCount + 1] = {}; ///< non-cumulative; last one is +Inf
+};
+
+struct OriginStats {
+    std::map<std::string, Series> byStatus;
+    std::map<int, std::uint64_t> errors; ///< by CURLcode
+    std::uint64_t bytesReceived = 0;
+    std::uint64_t bytesSent = 0;
+    std::uint64_t retries = 0;
+    std::uint64_t connectionReuses = 0;
+};
+
+struct Shard {
+    std::mutex mutex;
+    std::map<std::string, OriginStats> origins;
+};
+
+inline std::atomic<bool> enabled{true};
+inline std::mutex shardsMutex;
+inline std::vector<std::shared_ptr<Shard>> shards;
+
+inline Shard& localShard() {
+    thread_local Shard* shard = nullptr;
+    if (!shard) {
+        std::lock_guard<std::mutex> lock(shardsMutex);
+        shards.push_back(std::make_shared<Shard>());
+        shard = shards.back().get();
+    }
+    return *shard;
+}
+
+inline std::string statusClass(CURLcode code, long httpCode) {
+    if (code != CURLE_OK || httpCode < 100 || httpCode > 999) return "error";
+    return std::to_string(httpCode / 100) + "xx";
+}
+
+inline std::string labelEscape(const std::string& s) {
+    std::string out;
+    out.reserve(s.size());
+    for (char c : s) {
+        if (c == '\\') out += "\\\\";
+        else if (c == '"') out += "\\\"";
+        else if (c == '\n') out += "\\n";
+        else out += c;
+    }
+    return out;
+}
+
+inline std::string formatDouble(double value) {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%.10g", value);
+    return buf;
+}
+
+} // namespace detail
+
+inline void setEnabled(bool on) { detail::enabled.store(on, std::memory_order_relaxed); }
+inline bool enabled() { return detail::enabled.load(std::memory_order_relaxed); }
+
+/**
+ * @brief Records one transfer attempt.
+ * @param reused True if the attempt ran over an already open connection.
+ */
+inline void recordAttempt(const std::string& origin, CURLcode code, long httpCode, double seconds,
+                          std::uint64_t bytesReceived, std::uint64_t bytesSent, bool reused) {
+    if (!enabled()) return;
+    detail::Shard& shard = detail::localShard();
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    detail::OriginStats& stats = shard.origins[origin];
+    detail::Series& series = stats.byStatus[detail::statusClass(code, httpCode)];
+    series.count++;
+    series.sumSeconds += seconds;
+    size_t bucket = std::lower_bound(std::begin(latencyBuckets), std::end(latencyBuckets), seconds) - std::begin(latencyBuckets);
+    series.buckets[bucket]++;
+    stats.bytesReceived += bytesReceived;
+    stats.bytesSent += bytesSent;
+    if (reused) stats.connectionReuses++;
+    if (code != CURLE_OK) stats.errors[static_cast<int>(code)]++;
+}
+
+/** @brief Records that a failed attempt is about to be retried. */
+inline void recordRetry(const std::string& origin) {
+    if (!enabled()) return;
+    detail::Shard& shard = detail::localShard();
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.origins[origin].retries++;
+}
+
+/**
+ * @brief Merges all shards and renders them in the Prometheus text exposition format.
+ */
+inline std::string prometheus() {
+    std::map<std::string, detail::OriginStats> merged;
+    {
+        std::lock_guard<std::mutex> lock(detail::shardsMutex);
+        for (const auto& shard : detail::shards) {
+            std::lock_guard<std::mutex> shardLock(shard->mutex);
+            for (const auto& [origin, stats] : shard->origins) {
+                detail::OriginStats& total = merged[origin];
+                for (const auto& [status, series] : stats.byStatus) {
+                    detail::Series& sum = total.byStatus[status];
+                    sum.count += series.count;
+                    sum.sumSeconds += series.sumSeconds;
+                    for (size_t i = 0; i <= latencyBucketCount; ++i) sum.buckets[i] += series.buckets[i];
+                }
+                for (const auto& [code, count] : stats.errors) total.errors[code] += count;
+                total.bytesReceived += stats.bytesReceived;
+                total.bytesSent += stats.bytesSent;
+                total.retries += stats.retries;
+                total.connectionReuses += stats.connectionReuses;
+            }
+        }
+    }
+
+    std::ostringstream out;
+    auto perOrigin = [&](const char* name, const char* type, const char* help,
+                         const std::function<std::uint64_t(const detail::OriginStats&)>& value) {
+        out << "# HELP " << name << ' ' << help << "\n# TYPE " << name << ' ' << type << '\n';
+        for (const auto& [origin, stats] : merged) {
+            out << name << "{origin=\"" << detail::labelEscape(origin) << "\"} " << value(stats) << '\n';
+        }
+    };
+
+    out << "# HELP curling_requests_total Transfer attempts by origin and status class.\n"
+           "# TYPE curling_requests_total counter\n";
+    for (const auto& [origin, stats] : merged) {
+        for (const auto& [status, series] : stats.byStatus) {
+            out << "curling_requests_total{origin=\"" << detail::labelEscape(origin) << "\",status=\"" << status << "\"} "
+                << series.count << '\n';
+        }
+    }
+
+    out << "# HELP curling_request_duration_seconds Transfer attempt latency by origin and status class.\n"
+           "# TYPE curling_request_duration_seconds histogram\n";
+    for (const auto& [origin, stats] : merged) {
+        for (const auto& [status, series] : stats.byStatus) {
+            std::string labels = "origin=\"" + detail::labelEscape(origin) + "\",status=\"" + status + "\"";
+            std::uint64_t cumulative = 0;
+            for (size_t i = 0; i < latencyBucketCount; ++i) {
+                cumulative += series.buckets[i];
+                out << "curling_request_duration_seconds_bucket{" << labels << ",le=\""
+                    << detail::formatDouble(latencyBuckets[i]) << "\"} " << cumulative << '\n';
+            }
+            out << "curling_request_duration_seconds_bucket{" << labels << ",le=\"+Inf\"} " << series.count << '\n'
+                << "curling_request_duration_seconds_sum{" << labels << "} " << detail::formatDouble(series.sumSeconds) << '\n'
+                << "curling_request_duration_seconds_count{" << labels << "} " << series.count << '\n';
+        }
+    }
+
+    perOrigin("curling_response_bytes_total", "counter", "Bytes downloaded.",
+              [](const detail::OriginStats& s) { return s.bytesReceived; });
+    perOrigin("curling_request_bytes_total", "counter", "Bytes uploaded.",
+              [](const detail::OriginStats& s) { return s.bytesSent; });
+    perOrigin("curling_retries_total", "counter", "Failed attempts that were retried.",
+              [](const detail::OriginStats& s) { return s.retries; });
+    perOrigin("curling_connection_reuses_total", "counter", "Attempts served over an already open connection.",
+              [](const detail::OriginStats& s) { return s.connectionReuses; });
+
+    out << "# HELP curling_errors_total Failed attempts by libcurl result code.\n"
+           "# TYPE curling_errors_total counter\n";
+    for (const auto& [origin, stats] : merged) {
+        for (const auto& [code, count] : stats.errors) {
+            out << "curling_errors_total{origin=\"" << detail::labelEscape(origin) << "\",code=\"" << code
+                << "\",error=\"" << detail::labelEscape(curl_easy_strerror(static_cast<CURLcode>(code))) << "\"} "
+                << count << '\n';
+        }
+    }
+    return out.str();
+}
+
+/**
+ * @brief Writes prometheus() to a file, atomically replacing it (textfile collector friendly).
+ * @throws CurlingException if the file cannot be written.
+ */
+inline void writePrometheus(const std::string& path) {
+    std::string text = prometheus();
+    std::string tmp = path + ".tmp";
+    {
+        FilePtr file(std::fopen(tmp.c_str(), "wb"));
+        if (!file || std::fwrite(text.data(), 1, text.size(), file.get()) != text.size() || std::fflush(file.get()) != 0) {
+            throw CurlingException("Failed to write metrics file: " + tmp);
+        }
+    }
+    if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+        throw CurlingException("Failed to replace metrics file: " + path);
+    }
+}
+
+/** @brief Zeroes every metric. */
+inline void reset() {
+    std::lock_guard<std::mutex> lock(detail::shardsMutex);
+    for (const auto& shard : detail::shards) {
+        std::lock_guard<std::mutex> shardLock(shard->mutex);
+        shard->origins.clear();
+    }
+}
+
+} // namespace metrics
+
+
+/**
+ * @class Sink
+ * @brief Destination of a response body.
+ *
+ * Request::setSink() routes the body through a Sink instead of buffering it in
+ * Response::body. begin() is called before every attempt, so a retried transfer
+ * starts from scratch; end() once the transfer succeeded.
+ */
+class Sink : public std::enable_shared_from_this<Sink> {
+public:
+    virtual ~Sink() = default;
+
+    /**
+     * @brief Prepares for a (new) attempt.
+     * @return False if the sink cannot accept data; error() says why.
+     */
+    virtual bool begin() { return true; }
+
+    /**
+     * @brief Receives the next chunk of body.
+     * @return False to abort the transfer.
+     */
+    virtual bool write(const char* data, size_t length) = 0;
+
+    /**
+     * @brief Completes a successful transfer (flush, close, finalize).
+     * @return False if the body could not be completed; error() says why.
+     */
+    virtual bool end() { return true; }
+
+    const std::string& error() const { return errorMessage; }
+
+protected:
+    std::string errorMessage;
+};
+
+namespace detail {
+
+inline size_t SinkWriteCallback(char* data, size_t size, size_t nmemb, void* userp) {
+    const size_t length = size * nmemb;
+    return static_cast<Sink*>(userp)->write(data, length) ? length : 0;
+}
+
+/** Streaming SHA-256 (FIPS 180-4). */
+class Sha256 {
+public:
+    Sha256() { reset(); }
+
+    void reset() {
+        static const std::uint32_t init[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                                              0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+        std::copy(init, init + 8, state);
+        length = 0;
+        buffered = 0;
+    }
+
+    void update(const unsigned char* data, size_t size) {
+        length += size;
+        if (buffered) {
+            size_t take = std::min(size, sizeof(buffer) - buffered);
+            std::memcpy(buffer + buffered, data, take);
+            buffered += take;
+            data += take;
+            size -= take;
+            if (buffered < sizeof(buffer)) return;
+            compress(buffer);
+            buffered = 0;
+        }
+        for (; size >= 64; data += 64, size -= 64) compress(data);
+        std::memcpy(buffer, data, size);
+        buffered = size;
+    }
+
+    /** @brief Digest of the data so far; the hash can keep being updated. */
+    std::string hex() const {
+        Sha256 final = *this;
+        std::uint64_t bits = length * 8;
+        unsigned char pad[72] = {0x80};
+        size_t padLength = (buffered < 56 ? 56 : 120) - buffered;
+        for (int i = 0; i < 8; ++i) pad[padLength + i] = static_cast<unsigned char>(bits >> (56 - 8 * i));
+        final.update(pad, padLength + 8);
+
+        static const char digits[] = "0123456789abcdef";
+        std::string out;
+        for (std::uint32_t word : final.state) {
+            for (int shift = 28; shift >= 0; shift -= 4) out += digits[(word >> shift) & 0xf];
+        }
+        return out;
+    }
+
+private:
+    std::uint32_t state[8];
+    std::uint64_t length;
+    unsigned char buffer[64];
+    size_t buffered;
+
+    static std::uint32_t rotr(std::uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+    void compress(const unsigned char* block) {
+        static const std::uint32_t k[64] = {
+            0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+            0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+            0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+            0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+            0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+            0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+            0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+            0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+        std::uint32_t w[64];
+        for (int i = 0; i < 16; ++i) {
+            w[i] = (std::uint32_t(block[4 * i]) << 24) | (std::uint32_t(block[4 * i + 1]) << 16) |
+                   (std::uint32_t(block[4 * i + 2]) << 8) | std::uint32_t(block[4 * i + 3]);
+        }
+        for (int i = 16; i < 64; ++i) {
+            std::uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            std::uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+        std::uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        std::uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int i = 0; i < 64; ++i) {
+            std::uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + k[i] + w[i];
+            std::uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g; g = f; f = e; e = d + t1;
+            d = c; c = b; b = a; a = t1 + t2;
+        }
+        state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+        state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+    }
+};
+
+/** Streaming XXH64, seed 0. */
+class XxHash64 {
+public:
+    XxHash64() { reset(); }
+
+    void reset() {
+        acc[0] = prime1 + prime2;
+        acc[1] = prime2;
+        acc[2] = 0;
+        acc[3] = 0 - prime1;
+        length = 0;
+        buffered = 0;
+    }
+
+    void update(const unsigned char* data, size_t size) {
+        length += size;
+        if (buffered) {
+            size_t take = std::min(size, sizeof(buffer) - buffered);
+            std::memcpy(buffer + buffered, data, take);
+            buffered += take;
+            data += take;
+            size -= take;
+            if (buffered < sizeof(buffer)) return;
+            stripe(buffer);
+            buffered = 0;
+        }
+        for (; size >= 32; data += 32, size -= 32) stripe(data);
+        std::memcpy(buffer, data, size);
+        buffered = size;
+    }
+
+    std::string hex() const {
+        std::uint64_t h;
+        if (length >= 32) {
+            h = rotl(acc[0], 1) + rotl(acc[1], 7) + rotl(acc[2], 12) + rotl(acc[3], 18);
+            for (std::uint64_t v : acc) h = (h ^ round(0, v)) * prime1 + prime4;
+        } else {
+            h = prime5;
+        }
+        h += length;
+        const unsigned char* p = buffer;
+        const unsigned char* end = buffer + buffered;
+        for (; p + 8 <= end; p += 8) h = rotl(h ^ round(0, read(p, 8)), 27) * prime1 + prime4;
+        if (p + 4 <= end) {
+            h = rotl(h ^ (read(p, 4) * prime1), 23) * prime2 + prime3;
+            p += 4;
+        }
+        for (; p < end; ++p) h = rotl(h ^ (*p * prime5), 11) * prime1;
+        h ^= h >> 33;
+        h *= prime2;
+        h ^= h >> 29;
+        h *= prime3;
+        h ^= h >> 32;
+
+        char out[17];
+        std::snprintf(out, sizeof(out), "%016llx", static_cast<unsigned long long>(h));
+        return out;
+    }
+
+private:
+    static constexpr std::uint64_t prime1 = 0x9E3779B185EBCA87ULL;
+    static constexpr std::uint64_t prime2 = 0xC2B2AE3D27D4EB4FULL;
+    static constexpr std::uint64_t prime3 = 0x165667B19E3779F9ULL;
+    static constexpr std::uint64_t prime4 = 0x85EBCA77C2B2AE63ULL;
+    static constexpr std::uint64_t prime5 = 0x27D4EB2F165667C5ULL;
+
+    std::uint64_t acc[4];
+    std::uint64_t length;
+    unsigned char buffer[32];
+    size_t buffered;
+
+    static std::uint64_t rotl(std::uint64_t x, int n) { return (x << n) | (x >> (64 - n)); }
+    static std::uint64_t round(std::uint64_t a, std::uint64_t input) { return rotl(a + input * prime2, 31) * prime1; }
+    static std::uint64_t read(const unsigned char* p, int bytes) {
+        std::uint64_t v = 0;
+        for (int i = bytes - 1; i >= 0; --i) v = (v << 8) | p[i]; // little-endian
+        return v;
+    }
+
+    void stripe(const unsigned char* p) {
+        for (int i = 0; i < 4; ++i) acc[i] = round(acc[i], read(p + 8 * i, 8));
+    }
+};
+
+} // namespace detail
+
+/**
+ * @class MemorySink
+ * @brief Buffers the body in memory (what Request does by default).
+ */
+class MemorySink : public Sink {
+public:
+    bool begin() override { data.clear(); return true; }
+    bool write(const char* chunk, size_t length) override { data.append(chunk, length); return true; }
+
+    const std::string& body() const { return data; }
+    /** @brief Moves the buffered body out. */
+    std::string take() { return std::move(data); }
+
+private:
+    std::string data;
+};
+
+/**
+ * @class DiscardSink
+ * @brief Drops the body and only counts it; meant for load tests.
+ */
+class DiscardSink : public Sink {
+public:
+    bool begin() override { count = 0; return true; }
+    bool write(const char*, size_t length) override { count += length; return true; }
+
+    std::uint64_t bytes() const { return count; }
+
+private:
+    std::uint64_t count = 0;
+};
+
+/**
+ * @class FileSink
+ * @brief Writes the body to a file through a large stdio buffer.
+ *
+ * The file is created (truncated) on the first attempt and rewound on retries.
+ */
+class FileSink : public Sink {
 public:
-    explicit LogicException(const std::string& msg) : CurlingException(msg) {}
+    explicit FileSink(std::string path, size_t bufferSize = 1 << 20)
+        : path(std::move(path)), buffer(bufferSize) {}
+
+    bool begin() override {
+        if (!file) {
+            file.reset(std::fopen(path.c_str(), "wb"));
+            if (!file) {
+                errorMessage = "Failed to open file for writing: " + path;
+                return false;
+            }
+            if (!buffer.empty()) std::setvbuf(file.get(), buffer.data(), _IOFBF, buffer.size());
+            return true;
+        }
+        std::fflush(file.get());
+        if (::ftruncate(fileno(file.get()), 0) != 0 || fseeko(file.get(), 0, SEEK_SET) != 0) {
+            errorMessage = "Failed to rewind file: " + path;
+            return false;
+        }
+        return true;
+    }
+
+    bool write(const char* chunk, size_t length) override {
+        if (file && std::fwrite(chunk, 1, length, file.get()) == length) return true;
+        errorMessage = "Failed to write file: " + path;
+        return false;
+    }
+
+    bool end() override {
+        if (file && std::fclose(file.release()) != 0) {
+            errorMessage = "Failed to write file: " + path;
+            return false;
+        }
+        return true;
+    }
+
+private:
+    std::string path;
+    std::vector<char> buffer; // declared before file: stdio uses it until fclose
+    FilePtr file;
 };
 
-inline constexpr int version_major = 1;
-inline constexpr int version_minor = 2;
-inline constexpr int version_patch = 0;
+/**
+ * @class FdSink
+ * @brief Writes the body to a file descriptor (pipe, socket, stdout...).
+ *
+ * Data already written cannot be taken back, so a retried transfer writes the body again.
+ */
+class FdSink : public Sink {
+public:
+    explicit FdSink(int fd, bool closeOnDestroy = false) : fd(fd), owned(closeOnDestroy) {}
+    ~FdSink() override { if (owned) ::close(fd); }
+
+    bool write(const char* chunk, size_t length) override {
+        while (length > 0) {
+            ssize_t n = ::write(fd, chunk, length);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                errorMessage = std::string("Failed to write to descriptor: ") + std::strerror(errno);
+                return false;
+            }
+            chunk += n;
+            length -= static_cast<size_t>(n);
+        }
+        return true;
+    }
 
-inline std::string version() {
-    std::ostringstream oss;
-    oss << version_major << '.' << version_minor << '.' << version_patch;
-    return oss.str();
-}
+private:
+    int fd;
+    bool owned;
+};
 
 /**
- * @brief Util/helper section
- * @note meant for internal library use only
+ * @class PipeSink
+ * @brief Streams the body into the standard input of a shell command.
+ *
+ * end() waits for the command and fails if it exits with a non-zero status.
  */
-namespace detail {
+class PipeSink : public Sink {
+public:
+    explicit PipeSink(std::string command) : command(std::move(command)) {}
+    ~PipeSink() override { if (pipe) ::pclose(pipe); }
 
-inline std::once_flag curlGlobalInitFlag;
-inline std::mutex curlGlobalMutex;
+    bool begin() override {
+        if (!pipe) pipe = ::popen(command.c_str(), "w");
+        if (!pipe) errorMessage = "Failed to start command: " + command;
+        return pipe != nullptr;
+    }
 
-inline int instanceCount = 0;
+    bool write(const char* chunk, size_t length) override {
+        if (pipe && std::fwrite(chunk, 1, length, pipe) == length) return true;
+        errorMessage = "Failed to write to command: " + command;
+        return false;
+    }
 
-inline void ensureCurlGlobalInit() {
-    std::lock_guard<std::mutex> lock(curlGlobalMutex);
-    if (instanceCount++ == 0) {
-        if (curl_global_init(CURL_GLOBAL_DEFAULT) != CURLE_OK) {
-            throw InitializationException("Failed to initialize libcurl globally");
+    bool end() override {
+        if (!pipe) return true;
+        int status = ::pclose(pipe);
+        pipe = nullptr;
+        if (status != 0) {
+            errorMessage = "Command failed: " + command;
+            return false;
         }
+        return true;
     }
-}
 
-inline void maybeCleanupGlobalCurl() noexcept {
-    std::lock_guard<std::mutex> lock(curlGlobalMutex);
-    if (--instanceCount == 0) {
-        curl_global_cleanup();
+private:
+    std::string command;
+    FILE* pipe = nullptr;
+};
+
+/**
+ * @class TeeSink
+ * @brief Forwards the body to two sinks.
+ */
+class TeeSink : public Sink {
+public:
+    TeeSink(std::shared_ptr<Sink> first, std::shared_ptr<Sink> second)
+        : first(std::move(first)), second(std::move(second)) {}
+
+    bool begin() override { return forward(first->begin(), *first) && forward(second->begin(), *second); }
+    bool write(const char* chunk, size_t length) override {
+        return first->write(chunk, length) && second->write(chunk, length);
+    }
+    bool end() override {
+        bool a = forward(first->end(), *first);
+        bool b = forward(second->end(), *second);
+        return a && b;
     }
-}
 
-inline void trim(std::string& s) {
-    s.erase(s.begin(), std::find_if(s.begin(), s.end(), [](unsigned char ch){
-        return !std::isspace(ch);
-    }));
-    s.erase(std::find_if(s.rbegin(), s.rend(), [](unsigned char ch){
-        return !std::isspace(ch);
-    }).base(), s.end());
-}
+private:
+    std::shared_ptr<Sink> first, second;
 
-inline void toLowerCase(std::string& s) {
-    std::transform(s.begin(), s.end(), s.begin(),
-                   [](unsigned char c) { return std::tolower(c); });
-}
+    bool forward(bool ok, const Sink& sink) {
+        if (!ok) errorMessage = sink.error();
+        return ok;
+    }
+};
 
+/**
+ * @class DigestSink
+ * @brief Hashes the body as it streams by, without keeping it.
+ */
+class DigestSink : public Sink {
+public:
+    enum class Algorithm {
+        SHA256,  ///< Cryptographic, for integrity checks.
+        XXH64    ///< Very fast non-cryptographic hash, for change detection.
+    };
 
-inline size_t WriteCallback(void* contents, size_t size, size_t nmemb, void* userp) {
-    auto responseStream = static_cast<std::ostringstream*>(userp);
-    responseStream->write(static_cast<char*>(contents), size * nmemb);
-    return size * nmemb;
-}
+    explicit DigestSink(Algorithm algorithm = Algorithm::SHA256) : algorithm(algorithm) {}
 
-inline size_t HeaderCallback(char* buffer, size_t size, size_t nitems, void* userdata) {
-    auto* headerMap = static_cast<std::map<std::string, std::vector<std::string>>*>(userdata);
-    std::string headerLine(buffer, size * nitems);
+    bool begin() override {
+        sha.reset();
+        xxh.reset();
+        count = 0;
+        digest.clear();
+        return true;
+    }
 
-    if (headerLine.empty()) return 0; // skip the separation line
+    bool write(const char* chunk, size_t length) override {
+        auto bytes = reinterpret_cast<const unsigned char*>(chunk);
+        if (algorithm == Algorithm::SHA256) sha.update(bytes, length);
+        else xxh.update(bytes, length);
+        count += length;
+        return true;
+    }
 
-    auto colonPos = headerLine.find(":");
-    if (colonPos != std::string::npos) {
-        std::string key = headerLine.substr(0, colonPos);
-        std::string value = headerLine.substr(colonPos + 1);
-        detail::trim(key);
-        detail::trim(value);
-        detail::toLowerCase(key);
-        (*headerMap)[key].push_back(value);
+    bool end() override {
+        digest = algorithm == Algorithm::SHA256 ? sha.hex() : xxh.hex();
+        return true;
     }
 
-    return size * nitems;
+    /** @brief Lowercase hex digest, available after a successful transfer. */
+    const std::string& hex() const { return digest; }
+    std::uint64_t bytes() const { return count; }
+
+private:
+    Algorithm algorithm;
+    detail::Sha256 sha;
+    detail::XxHash64 xxh;
+    std::uint64_t count = 0;
+    std::string digest;
+};
+
+/**
+ * @class Buffer
+ * @brief Growable byte buffer with cheap copies and slices.
+ *
+ * Copies and slices share storage; the first write to shared storage copies the
+ * visible bytes (copy-on-write). A request body set from a Buffer keeps the bytes
+ * it was given even if the buffer is appended to afterwards.
+ */
+class Buffer {
+public:
+    Buffer() = default;
+    explicit Buffer(std::string bytes)
+        : data(std::make_shared<std::string>(std::move(bytes))), length(data->size()) {}
+
+    size_t size() const { return length; }
+    bool empty() const { return length == 0; }
+
+    std::string_view view() const {
+        return data ? std::string_view(data->data() + offset, length) : std::string_view();
+    }
+    std::string str() const { return std::string(view()); }
+
+    /** @brief Shared storage, for owners that must keep view() alive (e.g. Request::setBody). */
+    std::shared_ptr<const void> storage() const { return data; }
+
+    Buffer& append(std::string_view bytes) {
+        if (bytes.empty()) return *this;
+        // bytes may point into our own storage: copy it before the storage can move
+        if (data && bytes.data() >= data->data() && bytes.data() < data->data() + data->size()) {
+            return append(std::string(bytes));
+        }
+        detach(length + bytes.size());
+        data->append(bytes.data(), bytes.size());
+        length += bytes.size();
+        return *this;
+    }
+    Buffer& append(const Buffer& other) { return append(std::string(other.view())); }
+
+    void reserve(size_t capacity) { detach(std::max(capacity, length)); }
+
+    void clear() {
+        if (data && data.use_count() == 1) data->clear();
+        else data.reset();
+        offset = 0;
+        length = 0;
+    }
+
+    /** @brief Bytes [start, start + count), sharing storage; clamped to the buffer. */
+    Buffer slice(size_t start, size_t count = std::string_view::npos) const {
+        Buffer out;
+        start = std::min(start, length);
+        out.data = data;
+        out.offset = offset + start;
+        out.length = std::min(count, length - start);
+        return out;
+    }
+
+    /** @brief Position of needle at or after from, or std::string_view::npos. */
+    size_t find(std::string_view needle, size_t from = 0) const { return view().find(needle, from); }
+
+private:
+    std::shared_ptr<std::string> data;
+    size_t offset = 0;
+    size_t length = 0;
+
+    // make the storage private to this buffer, starting at offset 0, with room for capacity bytes
+    void detach(size_t capacity) {
+        if (data && data.use_count() == 1 && offset == 0 && data->size() == length) {
+            data->reserve(capacity);
+            return;
+        }
+        auto copy = std::make_shared<std::string>();
+        copy->reserve(capacity);
+        copy->append(view());
+        data = std::move(copy);
+        offset = 0;
+    }
+};
+
+/**
+ * @class BodySource
+ * @brief Streams a request body to libcurl instead of handing it over as one string.
+ *
+ * begin() is called before every attempt, so a retried upload starts from the first byte.
+ */
+class BodySource : public std::enable_shared_from_this<BodySource> {
+public:
+    virtual ~BodySource() = default;
+
+    /**
+     * @brief Rewinds to the first byte.
+     * @return False if the source cannot (re)start; error() says why.
+     */
+    virtual bool begin() { return true; }
+
+    /**
+     * @brief Copies up to capacity bytes into buffer; length 0 means end of body.
+     * @return False to abort the upload.
+     */
+    virtual bool read(char* buffer, size_t capacity, size_t& length) = 0;
+
+    /** @brief Body size in bytes, or -1 when unknown (sent with chunked encoding). Valid after begin(). */
+    virtual curl_off_t size() const { return -1; }
+
+    const std::string& error() const { return errorMessage; }
+
+protected:
+    std::string errorMessage;
+};
+
+namespace detail {
+
+inline size_t SourceReadCallback(char* buffer, size_t size, size_t nitems, void* userp) {
+    size_t length = 0;
+    if (!static_cast<BodySource*>(userp)->read(buffer, size * nitems, length)) return CURL_READFUNC_ABORT;
+    return length;
 }
 
-inline int ProgressCallbackBridge(void* clientp, curl_off_t dltotal, curl_off_t dlnow,
-                                  curl_off_t ultotal, curl_off_t ulnow);
+// libcurl rewinds the body when it has to send it again (redirect, authentication)
+inline int SourceSeekCallback(void* userp, curl_off_t offset, int origin) {
+    if (offset != 0 || origin != SEEK_SET) return CURL_SEEKFUNC_CANTSEEK;
+    return static_cast<BodySource*>(userp)->begin() ? CURL_SEEKFUNC_OK : CURL_SEEKFUNC_CANTSEEK;
+}
 
+} // namespace detail
 
-}//detail end
+/**
+ * @class MemorySource
+ * @brief Uploads a string it owns, without copying it into libcurl.
+ */
+class MemorySource : public BodySource {
+public:
+    explicit MemorySource(std::string data) : data(std::move(data)) {}
 
+    bool begin() override { offset = 0; return true; }
 
+    bool read(char* buffer, size_t capacity, size_t& length) override {
+        length = std::min(capacity, data.size() - offset);
+        std::memcpy(buffer, data.data() + offset, length);
+        offset += length;
+        return true;
+    }
 
-/** SAFETY: RAII deleters for CURL handles */
-struct CurlHandleDeleter { void operator()(CURL* h) const noexcept { if (h) curl_easy_cleanup(h); }};
-struct CurlSlistDeleter { void operator()(curl_slist* l) const noexcept { if (l) curl_slist_free_all(l); }};
-struct CurlMimeDeleter { void operator()(curl_mime* m) const noexcept { if (m) curl_mime_free(m); }};
-struct FileCloser { void operator()(FILE* file) const noexcept { if (file) std::fclose(file); }};
+    curl_off_t size() const override { return static_cast<curl_off_t>(data.size()); }
 
-using CurlPtr = std::unique_ptr<CURL, CurlHandleDeleter>;
-using CurlSlistPtr = std::unique_ptr<curl_slist, CurlSlistDeleter>;
-using CurlMimePtr = std::unique_ptr<curl_mime, CurlMimeDeleter>;
-using FilePtr = std::unique_ptr<FILE, FileCloser>;
+private:
+    std::string data;
+    size_t offset = 0;
+};
+
+/**
+ * @class FileSource
+ * @brief Uploads a file through a read-only memory mapping.
+ *
+ * Pages are faulted in as libcurl consumes them, so memory use does not grow with the file size.
+ */
+class FileSource : public BodySource {
+public:
+    explicit FileSource(std::string path) : path(std::move(path)) {}
+    FileSource(const FileSource&) = delete;
+    FileSource& operator=(const FileSource&) = delete;
+    ~FileSource() override { unmap(); }
+
+    bool begin() override {
+        offset = 0;
+        released = 0;
+        if (opened) return true;
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            errorMessage = "Failed to open file for reading: " + path;
+            return false;
+        }
+        struct stat info;
+        if (::fstat(fd, &info) != 0) {
+            ::close(fd);
+            errorMessage = "Failed to stat file: " + path;
+            return false;
+        }
+        length = static_cast<size_t>(info.st_size);
+        if (length > 0) {
+            void* addr = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr == MAP_FAILED) {
+                ::close(fd);
+                errorMessage = "Failed to map file: " + path;
+                return false;
+            }
+            map = static_cast<const char*>(addr);
+            ::madvise(addr, length, MADV_SEQUENTIAL);
+        }
+        ::close(fd); // the mapping stays valid
+        opened = true;
+        return true;
+    }
+
+    bool read(char* buffer, size_t capacity, size_t& count) override {
+        count = std::min(capacity, length - offset);
+        if (count) std::memcpy(buffer, map + offset, count);
+        offset += count;
+        if (offset - released >= releaseWindow) {
+            // drop pages already sent so resident memory stays flat for large files
+            size_t end = offset & ~(releaseWindow - 1);
+            ::madvise(const_cast<char*>(map) + released, end - released, MADV_DONTNEED);
+            released = end;
+        }
+        return true;
+    }
 
+    curl_off_t size() const override { return opened ? static_cast<curl_off_t>(length) : -1; }
+
+private:
+    std::string path;
+    const char* map = nullptr;
+    size_t length = 0;
+    size_t offset = 0;
+    size_t released = 0;
+    bool opened = false;
+    static constexpr size_t releaseWindow = 8 << 20; // multiple of the page size
+
+    void unmap() {
+        if (map) ::munmap(const_cast<char*>(map), length);
+        map = nullptr;
+    }
+};
 
 /**
  * @struct Response
@@ -290,6 +2099,77 @@ struct Response {
     }
 };
 
+/**
+ * @struct Error
+ * @brief Describes why a request failed, as returned by Request::trySend().
+ */
+struct Error {
+    /**
+     * @enum Kind
+     * @brief Where the failure happened.
+     */
+    enum class Kind {
+        TRANSPORT,     ///< libcurl reported an error; see code.
+        CIRCUIT_OPEN,  ///< The origin's circuit breaker is open; nothing was sent (code is CURLE_COULDNT_CONNECT).
+        /// The local end of the transfer failed; nothing is retried. The download file or a sink
+        /// could not be opened, a sink rejected the body, or its end() failed (code is
+        /// CURLE_WRITE_ERROR). A body source could not start or failed to produce data (code is
+        /// CURLE_READ_ERROR).
+        FILE
+    };
+
+    Kind kind;
+    CURLcode code;        ///< libcurl result of the last attempt.
+    long httpCode;        ///< HTTP status received before the failure, 0 if none.
+    std::string message;  ///< Human-readable description, same text send() would throw.
+
+    std::string toString() const { return message; }
+};
+
+/**
+ * @class Result
+ * @brief Holds either a value or an error, in the spirit of std::expected.
+ */
+template<typename T, typename E>
+class Result {
+public:
+    Result(T value) : storage(std::in_place_index<0>, std::move(value)) {}
+    Result(E error) : storage(std::in_place_index<1>, std::move(error)) {}
+
+    bool ok() const noexcept { return storage.index() == 0; }
+    explicit operator bool() const noexcept { return ok(); }
+
+    /**
+     * @throws LogicException if the result holds an error.
+     */
+    T& value() & { checkValue(); return std::get<0>(storage); }
+    const T& value() const & { checkValue(); return std::get<0>(storage); }
+    T&& value() && { checkValue(); return std::get<0>(std::move(storage)); }
+
+    /**
+     * @throws LogicException if the result holds a value.
+     */
+    E& error() & { checkError(); return std::get<1>(storage); }
+    const E& error() const & { checkError(); return std::get<1>(storage); }
+    E&& error() && { checkError(); return std::get<1>(std::move(storage)); }
+
+private:
+    std::variant<T, E> storage;
+
+    void checkValue() const { if (!ok()) throw LogicException("Result holds an error, not a value"); }
+    void checkError() const { if (ok()) throw LogicException("Result holds a value, not an error"); }
+};
+
+namespace detail {
+struct SendState;
+struct AsyncLoop;
+}
+
+/**
+ * @brief Receives the result of Request::sendAsync().
+ */
+using Completion = std::function<void(Result<Response, Error>)>;
+
 /**
  * @class Request
  * @brief Provides a fluent wrapper for HTTP requests via libcurl.
@@ -435,10 +2315,34 @@ public:
 
     /**
      * @brief Sets the body of the request (for POST/PUT/PATCH).
+     *
+     * The body is binary safe and handed to libcurl without another copy; it applies
+     * whether the method is set before or after it.
      * @param body Request body content.
      * @return *this
      */
     Request& setBody(const std::string& body);
+    Request& setBody(std::string&& body);
+
+    /**
+     * @brief Sets the body to bytes owned by someone else, without copying them.
+     * @param data Body bytes; must stay valid as long as owner is alive.
+     * @param owner Kept alive until the request is sent or reset.
+     * @return *this
+     */
+    Request& setBody(std::string_view data, std::shared_ptr<const void> owner);
+
+    /** @brief Sets the body to the bytes of a Buffer, sharing its storage. @return *this */
+    Request& setBody(const Buffer& buffer) { return setBody(buffer.view(), buffer.storage()); }
+
+    /**
+     * @brief Streams the body from a source (for POST/PUT/PATCH) instead of a string.
+     *
+     * A source of known size sets Content-Length; otherwise the body is sent with chunked
+     * encoding. Replaces any body set with setBody(). Pass nullptr to remove it.
+     * @return *this
+     */
+    Request& setBodySource(std::shared_ptr<BodySource> source);
 
     /**
      * @brief Enables download streaming to a file.
@@ -476,43 +2380,95 @@ public:
     Request& setAuthToken(const std::string& token);
 
     /**
-     * @brief Overrides default cookie file for persistence.
-     * @param path File path for storing cookies.
+     * @brief Overrides default cookie file for persistence.
+     * @param path File path for storing cookies.
+     * @return *this
+     */
+    Request& setCookiePath(const std::string& path);
+
+    /**
+     * @brief Sets the User-Agent header.
+     * @param userAgent Agent string.
+     * @return *this
+     */
+    Request& setUserAgent(const std::string& userAgent);
+
+    /**
+     * @brief Adds a field to multipart/form-data.
+     * @param fieldName Field name.
+     * @param value Field value.
+     * @return *this
+     * @throws MimeException on internal curl errors.
+     */
+    Request& addFormField(const std::string& fieldName, const std::string& value);
+
+    /**
+     * @brief Adds a file to multipart upload.
+     * @param fieldName Field name.
+     * @param filePath Path to file on disk.
+     * @return *this
+     * @throws MimeException on internal curl errors.
+     */
+    Request& addFormFile(const std::string& fieldName, const std::string& filePath);
+
+    /**
+     * @brief Enables or disables libcurl verbose output.
+     * @param enabled True to enable verbose mode.
+     * @return *this
+     */
+    Request& enableVerbose(bool enabled = true);
+
+    /**
+     * @brief Throttles this request with the given limiter (one token per attempt).
+     * @param limiter Shared limiter, or nullptr to fall back to the named/host lookup.
      * @return *this
      */
-    Request& setCookiePath(const std::string& path);
+    Request& setRateLimiter(std::shared_ptr<RateLimiter> limiter);
 
     /**
-     * @brief Sets the User-Agent header.
-     * @param userAgent Agent string.
+     * @brief Throttles this request with the process-wide limiter registered under key.
+     * @param key Name passed to defineRateLimiter(). Resolved when the request is sent.
      * @return *this
      */
-    Request& setUserAgent(const std::string& userAgent);
+    Request& setRateLimitKey(const std::string& key);
 
     /**
-     * @brief Adds a field to multipart/form-data.
-     * @param fieldName Field name.
-     * @param value Field value.
+     * @brief Splits downloadToFile() transfers into ranges fetched over parallel connections.
+     *
+     * The server is probed with HEAD; if it advertises "Accept-Ranges: bytes" and a length,
+     * the file is preallocated and filled with pwrite() by up to count concurrent range
+     * requests, whose sizes adapt to the measured throughput. Otherwise the download falls
+     * back to a single stream. Each range is retried up to the number of send() attempts.
+     * @param count Number of parallel connections (1 disables segmenting, max 64).
+     * @param minSegmentBytes Smallest range requested, also the size of the first ranges.
      * @return *this
-     * @throws MimeException on internal curl errors.
      */
-    Request& addFormField(const std::string& fieldName, const std::string& value);
+    Request& setSegments(unsigned count, curl_off_t minSegmentBytes = 1 << 20);
 
     /**
-     * @brief Adds a file to multipart upload.
-     * @param fieldName Field name.
-     * @param filePath Path to file on disk.
+     * @brief Lets downloadToFile() continue a partial file instead of starting over.
+     *
+     * The URL and the response's ETag (or Last-Modified) are kept in a "<file>.curling"
+     * sidecar. A later send(), in this process or another one, requests only the missing
+     * bytes with "Range: bytes=N-" and "If-Range: <validator>"; if the remote file changed
+     * the server answers 200 and the file is rewritten from the start. Every retry attempt
+     * resumes from the bytes already on disk. The sidecar is removed once the file is complete.
+     * A 206 whose Content-Range does not start at the end of the file aborts the attempt, and
+     * the next one starts over. A 416 whose Content-Range length equals the file size means the
+     * file was already complete; the send succeeds with that status.
+     * Error responses (other than 200/206) never touch the file. Segmenting is not used
+     * for resumable downloads.
      * @return *this
-     * @throws MimeException on internal curl errors.
      */
-    Request& addFormFile(const std::string& fieldName, const std::string& filePath);
+    Request& setResume(bool enabled = true);
 
     /**
-     * @brief Enables or disables libcurl verbose output.
-     * @param enabled True to enable verbose mode.
+     * @brief Routes the response body into a custom sink instead of Response::body.
+     *
+     * Takes precedence over downloadToFile(). Pass nullptr to go back to buffering.
      * @return *this
      */
-    Request& enableVerbose(bool enabled = true);
+    Request& setSink(std::shared_ptr<Sink> sink);
 
     /**
      * @brief Executes the HTTP request.
@@ -521,6 +2477,28 @@ public:
      */
     Response send(unsigned attempts = 1);
 
+    /**
+     * @brief Executes the HTTP request without throwing on transfer failures.
+     *
+     * Same retry behavior as send(), but failures are returned as an Error value,
+     * which avoids the cost of unwinding when errors are expected and frequent.
+     * @return The Response, or the Error of the last attempt.
+     * @throws LogicException only on misuse (zero attempts).
+     */
+    Result<Response, Error> trySend(unsigned attempts = 1);
+
+    /**
+     * @brief Starts the request on the calling thread's event loop and returns at once.
+     *
+     * The request is moved into the loop, which leaves this object reset, as after send().
+     * The transfer progresses while the thread is in poll(), or in a synchronous send.
+     * Retries and rate-limit tokens are waited for in the loop, without blocking the thread.
+     * Segmented downloads are not supported; the download uses a single stream.
+     * @param done Called by dispatch() with the Response or the Error of the last attempt.
+     * @throws LogicException on misuse (zero attempts, no callback).
+     */
+    void sendAsync(Completion done, unsigned attempts = 1);
+
     /**
      * @brief Resets internal state to allow reuse.
      */
@@ -546,10 +2524,12 @@ public:
 
     friend int detail::ProgressCallbackBridge(void* clientp, curl_off_t dltotal, curl_off_t dlnow,
                                           curl_off_t ultotal, curl_off_t ulnow);
+    friend struct detail::AsyncLoop;
 
 
 private:
     Method method;
+    std::shared_ptr<ConnectionCache> connectionCache; ///< declared before curlHandle: must outlive it
     CurlPtr curlHandle;
     CurlSlistPtr list;//headers;
     std::string url, args, body, cookieFile, cookieJar;
@@ -557,16 +2537,413 @@ private:
     std::string downloadFilePath;
     ProgressCallback progressCallback;
     HttpVersion httpVersion = HttpVersion::DEFAULT;
+    std::shared_ptr<RateLimiter> rateLimiter;
+    std::string rateLimitKey;
+    unsigned segments = 1;
+    curl_off_t minSegmentBytes = 1 << 20;
+    bool resume = false;
+    std::shared_ptr<Sink> sink;
+    std::shared_ptr<BodySource> bodySource;
+    std::string_view bodyView;               ///< body bytes when bodyOwner is set
+    std::shared_ptr<const void> bodyOwner;
 
     void clean() noexcept;
+    void attachConnectionCache();
     void updateURL();
-    void prepareCurlOptions(Response & response, FilePtr& fileOut, std::ostringstream & responseStream);
+    bool prepareCurlOptions(Response & response, FilePtr& fileOut, std::shared_ptr<Sink>& output,
+                            detail::ResumeState& resumeState);
+    void beginResumeAttempt(detail::ResumeState& state);
+    bool beginUpload();
     void setCurlHttpVersion();
+    std::shared_ptr<RateLimiter> resolveRateLimiter() const;
+    void traceAttempt(std::int64_t startUs, unsigned attempt, CURLcode res, long httpCode);
+    void recordMetrics(CURL* handle, const std::string& origin, CURLcode res, long httpCode);
+    std::optional<Result<Response, Error>> trySegmentedDownload(unsigned attempts);
+    std::optional<Error> beginSend(detail::SendState& state, unsigned attempts);
+    std::optional<Error> beginAttempt(detail::SendState& state);
+    std::optional<Result<Response, Error>> endAttempt(detail::SendState& state, CURLcode res);
+    unsigned announceRetry(const detail::SendState& state);
 };
 
 static_assert(!std::is_copy_constructible_v<Request> && !std::is_copy_assignable_v<Request>,
               "curling::Request is not copyable: it is thread-unsafe and must not be shared between threads. One instance per thread.");
 
+namespace detail {
+
+#ifdef CURLING_HAVE_USDT
+inline std::atomic<std::uint64_t> nextRequestId{1};
+
+/**
+ * @brief What the probes of one send report, and the write and header callbacks they wrap.
+ *
+ * Probes (provider "curling"; arg1 is the request id, arg2 the origin):
+ *   request-start  (id, origin, attempt)
+ *   connect-done   (id, origin, remote ip, remote port) connection ready, new or reused
+ *   first-byte     (id, origin, microseconds since the attempt started)
+ *   body-chunk     (id, bytes, body bytes so far in this attempt)
+ *   request-retry  (id, origin, failed attempt, backoff ms)
+ *   request-done   (id, origin, CURLcode, HTTP status, body bytes, attempt)
+ */
+struct ProbeState {
+    std::uint64_t id = 0;
+    const char* origin = "";
+    curl_write_callback write = nullptr;
+    void* writeData = nullptr;
+    void* headerData = nullptr;
+    std::int64_t attemptStartNs = 0;
+    curl_off_t bytes = 0;
+    bool firstByte = false;
+
+    void beginAttempt(unsigned attempt) {
+        attemptStartNs = steadyNowNs();
+        bytes = 0;
+        firstByte = false;
+        CURLING_PROBE(request__start, id, origin, attempt);
+    }
+};
+
+inline size_t ProbeWriteCallback(char* data, size_t size, size_t nmemb, void* userp) {
+    auto* probe = static_cast<ProbeState*>(userp);
+    const size_t length = size * nmemb;
+    probe->bytes += static_cast<curl_off_t>(length);
+    CURLING_PROBE(body__chunk, probe->id, length, probe->bytes);
+    return probe->write(data, size, nmemb, probe->writeData);
+}
+
+inline size_t ProbeHeaderCallback(char* buffer, size_t size, size_t nitems, void* userdata) {
+    auto* probe = static_cast<ProbeState*>(userdata);
+    if (!probe->firstByte) {
+        probe->firstByte = true;
+        CURLING_PROBE(first__byte, probe->id, probe->origin, (steadyNowNs() - probe->attemptStartNs) / 1000);
+    }
+    return HeaderCallback(buffer, size, nitems, probe->headerData);
+}
+
+#if LIBCURL_VERSION_NUM >= 0x075000 // CURLOPT_PREREQFUNCTION
+inline int ProbePrereqCallback(void* clientp, char* remoteIp, char*, int remotePort, int) {
+    auto* probe = static_cast<ProbeState*>(clientp);
+    CURLING_PROBE(connect__done, probe->id, probe->origin, remoteIp, remotePort);
+    return CURL_PREREQFUNC_OK;
+}
+#endif
+#endif // CURLING_HAVE_USDT
+
+/**
+ * @brief State of one send across its attempts.
+ * @note libcurl keeps pointers into it: it must not move once beginSend() has run.
+ */
+struct SendState {
+    Response response;
+    FilePtr fileOut;
+    std::shared_ptr<Sink> output;
+    ResumeState resumeState;
+    std::shared_ptr<RateLimiter> limiter;
+    std::shared_ptr<CircuitBreaker> breaker;
+    std::string origin;
+    bool uploading = false;
+    unsigned attempts = 1;
+    unsigned attempt = 0;          ///< current attempt, from 1
+    bool permitted = false;        ///< holds a breaker permission no outcome has used yet
+    std::int64_t attemptStartUs = -1;
+#ifdef CURLING_HAVE_USDT
+    ProbeState probe;
+#endif
+
+    SendState() = default;
+    SendState(const SendState&) = delete;
+    SendState& operator=(const SendState&) = delete;
+    // a send that ends or is cancelled between allowRequest() and its outcome frees its probe slot
+    ~SendState() { releasePermit(); }
+
+    void releasePermit() noexcept {
+        if (!permitted) return;
+        permitted = false;
+        breaker->releaseRequest();
+    }
+};
+
+#ifdef CURLING_HAVE_USDT
+// Routes the body and headers of the send through the probes; called once prepareCurlOptions() has chosen the outputs.
+inline void installProbes(CURL* handle, SendState& state) {
+    ProbeState& probe = state.probe;
+    probe.id = nextRequestId.fetch_add(1, std::memory_order_relaxed);
+    probe.origin = state.origin.c_str();
+    if (state.resumeState.file) {
+        probe.write = ResumeWriteCallback;
+        probe.writeData = &state.resumeState;
+    } else {
+        probe.write = SinkWriteCallback;
+        probe.writeData = state.output.get();
+    }
+    probe.headerData = &state.response.headers;
+    curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, ProbeWriteCallback);
+    curl_easy_setopt(handle, CURLOPT_WRITEDATA, &probe);
+    curl_easy_setopt(handle, CURLOPT_HEADERFUNCTION, ProbeHeaderCallback);
+    curl_easy_setopt(handle, CURLOPT_HEADERDATA, &probe);
+#if LIBCURL_VERSION_NUM >= 0x075000
+    curl_easy_setopt(handle, CURLOPT_PREREQFUNCTION, ProbePrereqCallback);
+    curl_easy_setopt(handle, CURLOPT_PREREQDATA, &probe);
+#endif
+}
+#endif
+
+inline void markFirstSend() {
+    if (firstSendNs.load(std::memory_order_relaxed) == 0) {
+        std::int64_t unset = 0;
+        firstSendNs.compare_exchange_strong(unset, steadyNowNs(), std::memory_order_relaxed);
+    }
+}
+
+/// A request started with sendAsync(), owned by the event loop until it completes.
+struct AsyncTransfer {
+    AsyncTransfer(Request&& r, Completion d) : request(std::move(r)), done(std::move(d)) {}
+    Request request;
+    SendState state;
+    Completion done;
+    std::int64_t retryAtNs = 0;
+    bool throttled = false; ///< holds a rate-limit token whose slot begins at retryAtNs
+};
+
+/**
+ * @brief Event loop of the transfers started with sendAsync() on one thread.
+ *
+ * Synchronous sends made while async transfers are running join the same multi handle,
+ * so the async ones keep progressing. Completions are queued and only run in dispatch(),
+ * never in the middle of a send.
+ */
+struct AsyncLoop {
+    CurlMultiPtr multi{curl_multi_init()};
+    std::vector<std::unique_ptr<AsyncTransfer>> running;  ///< in the multi handle
+    std::vector<std::unique_ptr<AsyncTransfer>> waiting;  ///< for a retry or a rate-limit slot, until retryAtNs
+    std::deque<std::function<void()>> completed;          ///< callbacks bound to their result
+
+    ~AsyncLoop() { cancel(); }
+
+    // Cancelled transfers give their breaker permissions back without counting a failure.
+    void cancel() noexcept {
+        for (auto& transfer : running) {
+            curl_multi_remove_handle(multi.get(), transfer->request.curlHandle.get());
+            transfer->state.releasePermit();
+        }
+        running.clear();
+        waiting.clear();
+        completed.clear();
+    }
+
+    void complete(std::unique_ptr<AsyncTransfer> transfer, Result<Response, Error> result) {
+        auto shared = std::make_shared<Result<Response, Error>>(std::move(result));
+        completed.push_back([done = std::move(transfer->done), shared] { done(std::move(*shared)); });
+    }
+
+    void start(std::unique_ptr<AsyncTransfer> transfer) {
+        Request& request = transfer->request;
+        if (transfer->state.limiter && !transfer->throttled) {
+            // claim the token now and wait for its slot in the loop, never by sleeping the thread
+            auto wait = transfer->state.limiter->reserve();
+            if (wait.count() > 0) {
+                transfer->throttled = true;
+                transfer->retryAtNs = steadyNowNs() + wait.count();
+                waiting.push_back(std::move(transfer));
+                return;
+            }
+        }
+        transfer->throttled = false;
+        if (auto error = request.beginAttempt(transfer->state)) {
+            request.reset();
+            complete(std::move(transfer), std::move(*error));
+            return;
+        }
+        if (!multi || curl_multi_add_handle(multi.get(), request.curlHandle.get()) != CURLM_OK) {
+            transfer->state.releasePermit();
+            request.reset();
+            complete(std::move(transfer), Error{Error::Kind::TRANSPORT, CURLE_FAILED_INIT, 0,
+                                                "Failed to add the transfer to the event loop"});
+            return;
+        }
+        running.push_back(std::move(transfer));
+    }
+
+    void finish(CURL* handle, CURLcode res) {
+        auto it = std::find_if(running.begin(), running.end(),
+                               [handle](const auto& t) { return t->request.curlHandle.get() == handle; });
+        if (it == running.end()) return;
+        std::unique_ptr<AsyncTransfer> transfer = std::move(*it);
+        running.erase(it);
+        curl_multi_remove_handle(multi.get(), handle);
+        if (auto result = transfer->request.endAttempt(transfer->state, res)) {
+            complete(std::move(transfer), std::move(*result));
+        } else {
+            unsigned delayMs = transfer->request.announceRetry(transfer->state);
+            transfer->retryAtNs = steadyNowNs() + static_cast<std::int64_t>(delayMs) * 1000000;
+            waiting.push_back(std::move(transfer));
+        }
+    }
+
+    void startDue() {
+        const std::int64_t now = steadyNowNs();
+        for (size_t i = 0; i < waiting.size();) {
+            if (waiting[i]->retryAtNs > now) {
+                ++i;
+                continue;
+            }
+            std::unique_ptr<AsyncTransfer> transfer = std::move(waiting[i]);
+            waiting.erase(waiting.begin() + static_cast<std::ptrdiff_t>(i));
+            start(std::move(transfer));
+        }
+    }
+
+    /// Milliseconds until the next retry is due, -1 if none is waiting.
+    long nextRetryMs() const {
+        if (waiting.empty()) return -1;
+        std::int64_t next = waiting.front()->retryAtNs;
+        for (const auto& transfer : waiting) next = std::min(next, transfer->retryAtNs);
+        return static_cast<long>(std::max<std::int64_t>(0, (next - steadyNowNs() + 999999) / 1000000));
+    }
+
+    /**
+     * @brief Runs the transfers and handles the finished ones.
+     * @return true if own finished, its result in ownResult.
+     */
+    bool drive(CURL* own = nullptr, CURLcode* ownResult = nullptr) {
+        int active = 0;
+        if (curl_multi_perform(multi.get(), &active) != CURLM_OK) {
+            if (ownResult) *ownResult = CURLE_FAILED_INIT;
+            return own != nullptr;
+        }
+        bool ownDone = false;
+        int pending = 0;
+        while (CURLMsg* message = curl_multi_info_read(multi.get(), &pending)) {
+            if (message->msg != CURLMSG_DONE) continue;
+            if (own && message->easy_handle == own) {
+                *ownResult = message->data.result;
+                ownDone = true;
+            } else {
+                finish(message->easy_handle, message->data.result);
+            }
+        }
+        return ownDone;
+    }
+};
+
+inline thread_local std::unique_ptr<AsyncLoop> asyncLoopPtr;
+
+inline AsyncLoop& asyncLoop() {
+    if (!asyncLoopPtr) asyncLoopPtr = std::make_unique<AsyncLoop>();
+    return *asyncLoopPtr;
+}
+
+/**
+ * @brief Runs a transfer to completion, giving idle time to the hook if one is set.
+ *
+ * Without a hook or async transfers this is curl_easy_perform(). Otherwise the transfer
+ * runs on the thread's event loop, next to the async transfers, and waits are cut into
+ * idleSliceMs slices for the hook.
+ */
+inline CURLcode perform(CURL* handle) {
+    BlockedScope blocked(Blocked::Transfer);
+    const bool background = asyncLoopPtr && !asyncLoopPtr->running.empty();
+    if (!idleHook && !background) return curl_easy_perform(handle);
+
+    AsyncLoop& loop = asyncLoop();
+    if (!loop.multi || curl_multi_add_handle(loop.multi.get(), handle) != CURLM_OK) return curl_easy_perform(handle);
+
+    CURLcode result = CURLE_OK;
+    bool hungry = idleHook && idleHook(); // the hook still wants idle time during this transfer
+    while (!loop.drive(handle, &result)) {
+        int events = 0;
+        curl_multi_poll(loop.multi.get(), nullptr, 0, hungry ? idleSliceMs : 1000, &events);
+        if (events == 0 && hungry && idleHook) hungry = idleHook();
+    }
+    curl_multi_remove_handle(loop.multi.get(), handle);
+    return result;
+}
+
+} // namespace detail
+
+/**
+ * @brief Runs the calling thread's async transfers for up to timeoutMs milliseconds.
+ *
+ * Returns early on network activity, when a transfer completes or when fd (unless -1)
+ * becomes readable; -1 waits until one of these happens. Completion callbacks are queued
+ * for dispatch() rather than run here.
+ * @return true if fd is readable.
+ */
+inline bool poll(long timeoutMs, int fd = -1) {
+    detail::AsyncLoop& loop = detail::asyncLoop();
+    loop.startDue();
+    loop.drive();
+    if (fd < 0 && loop.running.empty() && loop.waiting.empty()) return false; // nothing to wait for
+
+    long waitMs = loop.completed.empty() ? timeoutMs : 0;
+    const long retryMs = loop.nextRetryMs();
+    if (retryMs >= 0 && (waitMs < 0 || retryMs < waitMs)) waitMs = retryMs;
+    if (waitMs < 0 || waitMs > INT_MAX) waitMs = INT_MAX;
+
+    curl_waitfd extra{fd, CURL_WAIT_POLLIN, 0};
+    int events = 0;
+    {
+        detail::BlockedScope blocked(Blocked::Poll);
+        curl_multi_poll(loop.multi.get(), fd >= 0 ? &extra : nullptr, fd >= 0 ? 1 : 0, static_cast<int>(waitMs), &events);
+    }
+    loop.startDue();
+    loop.drive();
+    return fd >= 0 && (extra.revents & CURL_WAIT_POLLIN);
+}
+
+/**
+ * @brief Runs the completion callbacks queued by poll() or synchronous sends.
+ * @return The number of callbacks run. An exception from a callback propagates; the
+ * callbacks after it stay queued.
+ */
+inline size_t dispatch() {
+    if (!detail::asyncLoopPtr) return 0;
+    auto& completed = detail::asyncLoopPtr->completed;
+    size_t count = completed.size(); // completions queued by these callbacks wait for the next call
+    size_t ran = 0;
+    for (; ran < count && !completed.empty(); ++ran) {
+        std::function<void()> callback = std::move(completed.front());
+        completed.pop_front();
+        callback();
+    }
+    return ran;
+}
+
+/**
+ * @brief Async transfers of the calling thread that are running, waiting to retry or completed
+ * but not dispatched yet.
+ */
+inline size_t pending() {
+    if (!detail::asyncLoopPtr) return 0;
+    const auto& loop = *detail::asyncLoopPtr;
+    return loop.running.size() + loop.waiting.size() + loop.completed.size();
+}
+
+/**
+ * @brief Completed async transfers of the calling thread whose callbacks wait for dispatch().
+ */
+inline size_t ready() {
+    return detail::asyncLoopPtr ? detail::asyncLoopPtr->completed.size() : 0;
+}
+
+/**
+ * @brief Polls and dispatches until every async transfer of the calling thread has completed.
+ */
+inline void runPending() {
+    while (pending() > 0) {
+        poll(-1);
+        dispatch();
+    }
+}
+
+/**
+ * @brief Drops the async transfers of the calling thread without running their callbacks.
+ * @note The Lua bindings call it when their state is closed; other hosts call it before
+ * destroying what the callbacks refer to.
+ */
+inline void cancelPending() noexcept {
+    if (detail::asyncLoopPtr) detail::asyncLoopPtr->cancel();
+}
+
 namespace detail{
 inline int ProgressCallbackBridge(void* clientp, curl_off_t dltotal, curl_off_t dlnow,
                                     curl_off_t ultotal, curl_off_t ulnow) {
@@ -591,6 +2968,7 @@ inline Request::Request() : method(Method::GET), curlHandle(nullptr), list(nullp
     if (!curlHandle) {
         throw InitializationException("Curl initialization failed");
     }
+    attachConnectionCache();
 
     //set default method
     curl_easy_setopt(curlHandle.get(), CURLOPT_HTTPGET, 1L);
@@ -598,6 +2976,7 @@ inline Request::Request() : method(Method::GET), curlHandle(nullptr), list(nullp
 
 inline Request::Request(Request&& other) noexcept
    :method(other.method),
+    connectionCache(std::move(other.connectionCache)),
     curlHandle(std::move(other.curlHandle)),
     list(std::move(other.list)),
     url(std::move(other.url)),
@@ -605,7 +2984,20 @@ inline Request::Request(Request&& other) noexcept
     body(std::move(other.body)),
     cookieFile(std::move(other.cookieFile)),
     cookieJar(std::move(other.cookieJar)),
-    mime(std::move(other.mime)){
+    mime(std::move(other.mime)),
+    downloadFilePath(std::move(other.downloadFilePath)),
+    progressCallback(std::move(other.progressCallback)),
+    httpVersion(other.httpVersion),
+    rateLimiter(std::move(other.rateLimiter)),
+    rateLimitKey(std::move(other.rateLimitKey)),
+    segments(other.segments),
+    minSegmentBytes(other.minSegmentBytes),
+    resume(other.resume),
+    sink(std::move(other.sink)),
+    bodySource(std::move(other.bodySource)),
+    bodyView(other.bodyView),
+    bodyOwner(std::move(other.bodyOwner)){
+    detail::ensureCurlGlobalInit(); // both objects are destroyed, and each releases libcurl once
 }
 
 inline Request& Request::operator=(Request&& other) noexcept {
@@ -615,6 +3007,7 @@ inline Request& Request::operator=(Request&& other) noexcept {
         //transfer ownership
         method = other.method;
         curlHandle = std::move(other.curlHandle);
+        connectionCache = std::move(other.connectionCache);
         list = std::move(other.list);
         mime = std::move(other.mime);
 
@@ -623,6 +3016,18 @@ inline Request& Request::operator=(Request&& other) noexcept {
         body = std::move(other.body);
         cookieFile = std::move(other.cookieFile);
         cookieJar = std::move(other.cookieJar);
+        downloadFilePath = std::move(other.downloadFilePath);
+        progressCallback = std::move(other.progressCallback);
+        httpVersion = other.httpVersion;
+        rateLimiter = std::move(other.rateLimiter);
+        rateLimitKey = std::move(other.rateLimitKey);
+        segments = other.segments;
+        minSegmentBytes = other.minSegmentBytes;
+        resume = other.resume;
+        sink = std::move(other.sink);
+        bodySource = std::move(other.bodySource);
+        bodyView = other.bodyView;
+        bodyOwner = std::move(other.bodyOwner);
     }
     return *this;
 }
@@ -693,12 +3098,7 @@ inline Request& Request::setProgressCallback(ProgressCallback cb){
 }
 
 inline Request& Request::addHeader(const std::string& header) {
-    auto newList = curl_slist_append(list.get(), header.c_str());
-    if(!newList){
-        throw HeaderException("Failed to append header to curl_slist");
-    }
-    list.release(); //release is needed here to avoid double free, as newList will contain this old pointer somewhere down the list chain
-    list.reset(newList);
+    detail::appendHeader(list, header);
     curl_easy_setopt(curlHandle.get(), CURLOPT_HTTPHEADER, list.get());
     return *this;
 }
@@ -709,73 +3109,492 @@ inline Request& Request::downloadToFile(const std::string& path) {
 }
 
 inline Request& Request::setBody(const std::string& body) {
-    this->body = body;
-    if (method == Method::POST || method == Method::PUT || method == Method::PATCH) {
-        curl_easy_setopt(curlHandle.get(), CURLOPT_COPYPOSTFIELDS, this->body.c_str());
-    }
+    return setBody(std::string(body));
+}
+
+inline Request& Request::setBody(std::string&& body) {
+    this->body = std::move(body);
+    bodySource.reset();
+    bodyView = {};
+    bodyOwner.reset();
     return *this;
 }
 
-inline Response Request::send(unsigned attempts) {
+inline Request& Request::setBody(std::string_view data, std::shared_ptr<const void> owner) {
+    body.clear();
+    bodySource.reset();
+    bodyView = data;
+    bodyOwner = std::move(owner);
+    return *this;
+}
+
+inline Request& Request::setBodySource(std::shared_ptr<BodySource> source) {
+    bodySource = std::move(source);
+    body.clear();
+    bodyView = {};
+    bodyOwner.reset();
+    return *this;
+}
+
+inline Result<Response, Error> Request::trySend(unsigned attempts) {
     if (attempts == 0) {
         throw LogicException("Number of attempts must be greater than zero");
     }
+    detail::markFirstSend();
+
+    if (segments > 1 && !resume && !sink && !downloadFilePath.empty() && method == Method::GET) {
+        updateURL();
+        setCurlHttpVersion();
+        if (auto segmented = trySegmentedDownload(attempts)) {
+            reset();
+            return std::move(*segmented);
+        }
+    }
 
-    const unsigned baseDelayMs = 1000; // initial delay of 1 second
+    detail::SendState state;
+    if (auto error = beginSend(state, attempts)) {
+        reset();
+        return std::move(*error);
+    }
+    for (;;) {
+        if (state.limiter) {
+            trace::Span span("throttle", "ratelimit");
+            detail::BlockedScope blocked(Blocked::RateLimit);
+            state.limiter->acquire();
+        }
+        if (auto error = beginAttempt(state)) {
+            reset();
+            return std::move(*error);
+        }
+        CURLcode res = detail::perform(curlHandle.get());
+        if (auto result = endAttempt(state, res)) return std::move(*result);
+
+        unsigned delayMs = announceRetry(state);
+        trace::Span backoff("backoff", "retry");
+        backoff.args = "\"attempt\":" + std::to_string(state.attempt) + ",\"delay_ms\":" + std::to_string(delayMs);
+        detail::BlockedScope blocked(Blocked::Backoff);
+        waitMs(delayMs);
+    }
+}
 
-    Response response;
-    FilePtr fileOut(nullptr);
-    std::ostringstream responseStream;
+inline void Request::sendAsync(Completion done, unsigned attempts) {
+    if (attempts == 0) {
+        throw LogicException("Number of attempts must be greater than zero");
+    }
+    if (!done) {
+        throw LogicException("sendAsync needs a completion callback");
+    }
+    detail::markFirstSend();
+
+    auto transfer = std::make_unique<detail::AsyncTransfer>(std::move(*this), std::move(done));
+    reset(); // this object stays usable, as after send()
+
+    detail::AsyncLoop& loop = detail::asyncLoop();
+    Request& request = transfer->request;
+    if (auto error = request.beginSend(transfer->state, attempts)) {
+        request.reset();
+        loop.complete(std::move(transfer), std::move(*error));
+        return;
+    }
+    loop.start(std::move(transfer));
+}
 
-        
-    prepareCurlOptions(response, fileOut, responseStream);
+// Sets the options of a send and resolves its rate limiter and circuit breaker.
+inline std::optional<Error> Request::beginSend(detail::SendState& state, unsigned attempts) {
+    state.attempts = attempts;
+    if (!prepareCurlOptions(state.response, state.fileOut, state.output, state.resumeState)) {
+        return Error{Error::Kind::FILE, CURLE_WRITE_ERROR, 0, "Failed to open file for writing: " + downloadFilePath};
+    }
     updateURL();
     setCurlHttpVersion();
+    state.limiter = resolveRateLimiter();
+    state.breaker = findCircuitBreaker(url);
+    state.origin = detail::urlOrigin(url);
+    state.uploading = bodySource &&
+        (method == Method::POST || method == Method::PUT || method == Method::PATCH);
+#ifdef CURLING_HAVE_USDT
+    detail::installProbes(curlHandle.get(), state);
+#endif
+    return std::nullopt;
+}
 
-    for (unsigned attempt = 1; attempt <= attempts; ++attempt) {
-        
-        try{
-            // Perform request
-            CURLcode res = curl_easy_perform(curlHandle.get());
+// Readies the next attempt once its rate-limit token is held; an error ends the send.
+inline std::optional<Error> Request::beginAttempt(detail::SendState& state) {
+    ++state.attempt;
+    if (state.breaker && !state.breaker->allowRequest()) {
+        return Error{Error::Kind::CIRCUIT_OPEN, CURLE_COULDNT_CONNECT, 0,
+                     "Circuit open for " + state.origin + ", request not sent"};
+    }
+    state.permitted = state.breaker != nullptr;
 
-            // Get HTTP status code regardless of result
-            curl_easy_getinfo(curlHandle.get(), CURLINFO_RESPONSE_CODE, &(response.httpCode));
+    if (state.resumeState.file) beginResumeAttempt(state.resumeState);
+    if (state.output && !state.output->begin()) {
+        state.releasePermit();
+        return Error{Error::Kind::FILE, CURLE_WRITE_ERROR, 0, state.output->error()};
+    }
+    if (state.uploading && !beginUpload()) {
+        state.releasePermit();
+        return Error{Error::Kind::FILE, CURLE_READ_ERROR, 0, bodySource->error()};
+    }
+    state.attemptStartUs = trace::enabled() ? trace::nowUs() : -1;
+#ifdef CURLING_HAVE_USDT
+    state.probe.beginAttempt(state.attempt);
+#endif
+    return std::nullopt;
+}
 
-            if (res != CURLE_OK) {
-                throw RequestException(
-                    std::string("Curl perform failed on attempt ") + std::to_string(attempt) +
-                    ": " + curl_easy_strerror(res)
-                );
-            }
+// Records a finished attempt. Returns the result of the send, after which the request is
+// reset, or nothing when another attempt should follow.
+inline std::optional<Result<Response, Error>> Request::endAttempt(detail::SendState& state, CURLcode res) {
+    Response& response = state.response;
+    const std::shared_ptr<Sink>& output = state.output;
+
+    // Get HTTP status code regardless of result
+    curl_easy_getinfo(curlHandle.get(), CURLINFO_RESPONSE_CODE, &(response.httpCode));
+    CURLING_PROBE(request__done, state.probe.id, state.probe.origin, static_cast<int>(res), response.httpCode,
+                  state.probe.bytes, state.attempt);
+    if (state.breaker) {
+        state.permitted = false;
+        state.breaker->recordOutcome(res, response.httpCode);
+    }
+    if (state.attemptStartUs >= 0) traceAttempt(state.attemptStartUs, state.attempt, res, response.httpCode);
+    if (metrics::enabled()) recordMetrics(curlHandle.get(), state.origin, res, response.httpCode);
+
+    std::optional<Result<Response, Error>> result;
+    // A source or sink refusing data is not transient: do not retry
+    if (state.uploading && res == CURLE_ABORTED_BY_CALLBACK && !bodySource->error().empty()) {
+        result = Error{Error::Kind::FILE, CURLE_READ_ERROR, response.httpCode, bodySource->error()};
+    } else if (res == CURLE_WRITE_ERROR && output) {
+        result = Error{Error::Kind::FILE, res, response.httpCode,
+                       output->error().empty() ? "Response body rejected by sink" : output->error()};
+    } else if (res == CURLE_OK && output && !output->end()) {
+        result = Error{Error::Kind::FILE, CURLE_WRITE_ERROR, response.httpCode, output->error()};
+    } else if (res == CURLE_OK) {
+        // Store response body if it was buffered in memory
+        if (auto memory = std::dynamic_pointer_cast<MemorySink>(output); memory && !sink) {
+            response.body = memory->take();
+        }
+        detail::ResumeState& resumeState = state.resumeState;
+        if (resumeState.file && (resumeState.status == 200 || resumeState.status == 206 ||
+                                 detail::resumeAlreadyComplete(resumeState, response.httpCode))) {
+            std::remove(resumeState.sidecarPath.c_str());
+        } else if (resumeState.file && response.httpCode == 416 && resumeState.offset > 0) {
+            // the partial file does not fit the remote one: the next send starts over
+            std::remove(resumeState.sidecarPath.c_str());
+        }
+        result = std::move(response);
+    } else if (state.attempt == state.attempts) {
+        result = Error{Error::Kind::TRANSPORT, res, response.httpCode,
+                       std::string("Curl perform failed on attempt ") + std::to_string(state.attempt) +
+                       ": " + curl_easy_strerror(res)};
+    } else {
+        return std::nullopt;
+    }
+    reset(); // Reset for reuse
+    return result;
+}
 
-            // Store response body if not downloading to file
-            if (downloadFilePath.empty()) {
-                response.body = responseStream.str();
-            }
+// Reports a failed attempt that will be retried; returns the backoff delay before the next one.
+inline unsigned Request::announceRetry(const detail::SendState& state) {
+    const unsigned baseDelayMs = 1000; // initial delay of 1 second
+
+    // Calculate exponential backoff delay
+    unsigned delayMs = baseDelayMs * (1 << (state.attempt - 1));
+
+    // Optional: Add jitter (randomize slightly to avoid thundering herd)
+    // delayMs += rand() % 250;
+
+    std::cerr << "Retry attempt " << state.attempt << " failed. Retrying in " << delayMs << "ms...\n";
+    CURLING_PROBE(request__retry, state.probe.id, state.probe.origin, state.attempt, delayMs);
+
+    metrics::recordRetry(state.origin);
+    return delayMs;
+}
+
+inline void Request::traceAttempt(std::int64_t startUs, unsigned attempt, CURLcode res, long httpCode) {
+    // libcurl phase timings are cumulative offsets from the start of the transfer
+    curl_off_t dns = 0, connect = 0, tls = 0, pretransfer = 0, firstByte = 0, total = 0;
+    curl_easy_getinfo(curlHandle.get(), CURLINFO_NAMELOOKUP_TIME_T, &dns);
+    curl_easy_getinfo(curlHandle.get(), CURLINFO_CONNECT_TIME_T, &connect);
+    curl_easy_getinfo(curlHandle.get(), CURLINFO_APPCONNECT_TIME_T, &tls);
+    curl_easy_getinfo(curlHandle.get(), CURLINFO_PRETRANSFER_TIME_T, &pretransfer);
+    curl_easy_getinfo(curlHandle.get(), CURLINFO_STARTTRANSFER_TIME_T, &firstByte);
+    curl_easy_getinfo(curlHandle.get(), CURLINFO_TOTAL_TIME_T, &total);
+
+    std::string args = "\"url\":\"" + trace::detail::jsonEscape(url) + "\",\"attempt\":" + std::to_string(attempt) +
+                       ",\"status\":" + std::to_string(httpCode) + ",\"curlcode\":" + std::to_string(res);
+    trace::complete("request", "http", startUs, std::max<curl_off_t>(total, 1), args);
+
+    const curl_off_t connected = std::max(connect, tls);
+    const std::pair<const char*, std::pair<curl_off_t, curl_off_t>> phases[] = {
+        {"dns", {0, dns}},
+        {"connect", {dns, connect}},
+        {"tls", {connect, tls}},
+        {"send", {connected, pretransfer}},
+        {"wait", {pretransfer, firstByte}},
+        {"receive", {firstByte > 0 ? firstByte : total, total}}
+    };
+    for (const auto& phase : phases) {
+        curl_off_t from = phase.second.first, to = phase.second.second;
+        if (to > from && from >= 0) trace::complete(phase.first, "http", startUs + from, to - from);
+    }
+    if (res != CURLE_OK) {
+        trace::instant("error", "http", "\"message\":\"" + trace::detail::jsonEscape(curl_easy_strerror(res)) + "\"");
+    }
+}
+
+inline void Request::recordMetrics(CURL* handle, const std::string& origin, CURLcode res, long httpCode) {
+    curl_off_t totalUs = 0, received = 0, sent = 0;
+    long newConnections = 0;
+    curl_easy_getinfo(handle, CURLINFO_TOTAL_TIME_T, &totalUs);
+    curl_easy_getinfo(handle, CURLINFO_SIZE_DOWNLOAD_T, &received);
+    curl_easy_getinfo(handle, CURLINFO_SIZE_UPLOAD_T, &sent);
+    curl_easy_getinfo(handle, CURLINFO_NUM_CONNECTS, &newConnections);
+    metrics::recordAttempt(origin, res, httpCode, static_cast<double>(totalUs) / 1e6,
+                           static_cast<std::uint64_t>(received), static_cast<std::uint64_t>(sent),
+                           res == CURLE_OK && newConnections == 0);
+}
+
+inline std::optional<Result<Response, Error>> Request::trySegmentedDownload(unsigned attempts) {
+    using Clock = std::chrono::steady_clock;
+    const double targetSegmentSeconds = 2.0; // aim for ranges that take about this long
+
+    // The HEAD probe is a request of its own. This path is synchronous, so it may wait for its
+    // token like send() does; the segments below claim theirs with reserve() and never sleep.
+    auto limiter = resolveRateLimiter();
+    if (limiter) {
+        trace::Span span("throttle", "ratelimit");
+        detail::BlockedScope blocked(Blocked::RateLimit);
+        limiter->acquire();
+    }
+
+    const std::string origin = detail::urlOrigin(url);
+    auto breaker = findCircuitBreaker(url);
+    if (breaker && !breaker->allowRequest()) {
+        return Error{Error::Kind::CIRCUIT_OPEN, CURLE_COULDNT_CONNECT, 0, "Circuit open for " + origin + ", request not sent"};
+    }
+    // given back unless an outcome is recorded, e.g. when the single-stream path takes over
+    struct Permit {
+        CircuitBreaker* breaker;
+        ~Permit() {
+            if (breaker) breaker->releaseRequest();
+        }
+    } permit{breaker.get()};
+
+    // Probe for range support; on any doubt let the single-stream path handle it
+    Response response{};
+    CurlPtr probe(curl_easy_duphandle(curlHandle.get()));
+    if (!probe) return std::nullopt;
+    curl_easy_setopt(probe.get(), CURLOPT_NOBODY, 1L);
+    curl_easy_setopt(probe.get(), CURLOPT_NOPROGRESS, 1L);
+    curl_easy_setopt(probe.get(), CURLOPT_HEADERFUNCTION, detail::HeaderCallback);
+    curl_easy_setopt(probe.get(), CURLOPT_HEADERDATA, &(response.headers));
+    {
+        detail::BlockedScope blocked(Blocked::Transfer);
+        if (curl_easy_perform(probe.get()) != CURLE_OK) return std::nullopt;
+    }
+
+    curl_off_t size = -1;
+    char* effectiveUrl = nullptr;
+    curl_easy_getinfo(probe.get(), CURLINFO_RESPONSE_CODE, &(response.httpCode));
+    curl_easy_getinfo(probe.get(), CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &size);
+    curl_easy_getinfo(probe.get(), CURLINFO_EFFECTIVE_URL, &effectiveUrl);
+    auto acceptRanges = response.getHeader("Accept-Ranges");
+    bool rangeable = std::any_of(acceptRanges.begin(), acceptRanges.end(), [](std::string v) {
+        detail::toLowerCase(v);
+        return v == "bytes";
+    });
+    if (response.httpCode != 200 || size <= minSegmentBytes || !rangeable || !effectiveUrl) return std::nullopt;
+    const std::string target = effectiveUrl;
+    probe.reset();
+
+    CurlMultiPtr multi(curl_multi_init());
+    if (!multi) return Error{Error::Kind::TRANSPORT, CURLE_FAILED_INIT, 0, "Curl multi initialization failed"};
+
+    // only now is the transfer certain to start, so only now is the file replaced
+    int fd = ::open(downloadFilePath.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return Error{Error::Kind::FILE, CURLE_WRITE_ERROR, 0, "Failed to open file for writing: " + downloadFilePath};
+    }
+    std::unique_ptr<int, void (*)(int*)> fdGuard(&fd, [](int* f) { ::close(*f); });
+    if (int rc = detail::preallocate(fd, size)) {
+        return Error{Error::Kind::FILE, CURLE_WRITE_ERROR, 0,
+                     "Failed to preallocate " + downloadFilePath + ": " + std::strerror(rc)};
+    }
+
+    struct Segment {
+        CurlPtr handle;
+        detail::SegmentWriter writer;
+        curl_off_t begin;
+        unsigned failures;
+        Clock::time_point startAt;
+        std::int64_t traceStartUs;
+        std::string range;
+    };
+    struct Range {
+        curl_off_t begin, end;
+        unsigned failures;
+    };
+
+    std::map<CURL*, std::unique_ptr<Segment>> active;
+    std::vector<std::unique_ptr<Segment>> delayed; // waiting for a rate-limit slot, no thread is blocked
+    std::deque<Range> retries;
+    curl_off_t nextOffset = 0;
+    curl_off_t segmentSize = minSegmentBytes;
+    curl_off_t written = 0;
+    unsigned attempt = 1; // the furthest any range has got
+    const curl_off_t maxSegment = std::max(minSegmentBytes, size / static_cast<curl_off_t>(segments));
+    std::optional<Error> failure;
+
+    auto start = [&](std::unique_ptr<Segment> segment) {
+        segment->traceStartUs = trace::enabled() ? trace::nowUs() : -1;
+        CURL* handle = segment->handle.get();
+        active.emplace(handle, std::move(segment));
+        curl_multi_add_handle(multi.get(), handle);
+    };
 
-            reset(); // Reset for reuse
-            return response;
+    auto launch = [&]() {
+        while (!failure && active.size() + delayed.size() < segments) {
+            Range range;
+            if (!retries.empty()) {
+                range = retries.front();
+                retries.pop_front();
+            } else if (nextOffset < size) {
+                // shrink ranges near the end so one slow connection does not hold up the tail
+                curl_off_t remaining = size - nextOffset;
+                curl_off_t length = std::min(segmentSize, std::max(minSegmentBytes, remaining / static_cast<curl_off_t>(segments)));
+                range = Range{nextOffset, std::min(size, nextOffset + length), 0};
+                nextOffset = range.end;
+            } else {
+                break;
+            }
 
-        } catch (const RequestException& e) {
-            if (attempt == attempts) {
-                reset();
-                throw; // rethrow if final attempt fails
+            auto segment = std::make_unique<Segment>();
+            segment->handle.reset(curl_easy_duphandle(curlHandle.get()));
+            if (!segment->handle) {
+                failure = Error{Error::Kind::TRANSPORT, CURLE_FAILED_INIT, 0, "Curl handle duplication failed"};
+                break;
             }
+            CURL* handle = segment->handle.get();
+            segment->begin = range.begin;
+            segment->failures = range.failures;
+            segment->writer = detail::SegmentWriter{fd, handle, range.begin, range.end, false};
+            segment->range = std::to_string(range.begin) + "-" + std::to_string(range.end - 1);
+            curl_easy_setopt(handle, CURLOPT_URL, target.c_str());
+            curl_easy_setopt(handle, CURLOPT_RANGE, segment->range.c_str());
+            curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, detail::SegmentWriteCallback);
+            curl_easy_setopt(handle, CURLOPT_WRITEDATA, &(segment->writer));
+            curl_easy_setopt(handle, CURLOPT_NOPROGRESS, 1L);
+
+            auto wait = limiter ? limiter->reserve() : std::chrono::nanoseconds(0);
+            if (wait.count() > 0) {
+                segment->startAt = Clock::now() + wait;
+                delayed.push_back(std::move(segment));
+            } else {
+                start(std::move(segment));
+            }
+        }
+    };
 
-            // Calculate exponential backoff delay
-            unsigned delayMs = baseDelayMs * (1 << (attempt - 1));
+    launch();
+    bool idleHungry = detail::idleHook && detail::idleHook();
+    while (!failure && (!active.empty() || !delayed.empty())) {
+        auto now = Clock::now();
+        int timeoutMs = 100;
+        for (auto it = delayed.begin(); it != delayed.end();) {
+            if ((*it)->startAt <= now) {
+                start(std::move(*it));
+                it = delayed.erase(it);
+            } else {
+                auto ms = std::chrono::duration_cast<std::chrono::milliseconds>((*it)->startAt - now).count() + 1;
+                timeoutMs = std::min<int>(timeoutMs, static_cast<int>(ms));
+                ++it;
+            }
+        }
 
-            // Optional: Add jitter (randomize slightly to avoid thundering herd)
-            // delayMs += rand() % 250;
+        int running = 0;
+        curl_multi_perform(multi.get(), &running);
+
+        int queued = 0;
+        while (CURLMsg* msg = curl_multi_info_read(multi.get(), &queued)) {
+            if (msg->msg != CURLMSG_DONE) continue;
+            CURL* handle = msg->easy_handle;
+            CURLcode res = msg->data.result;
+            curl_multi_remove_handle(multi.get(), handle);
+            auto node = active.extract(handle);
+            Segment& segment = *node.mapped();
+
+            long httpCode = 0;
+            curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &httpCode);
+            if (res == CURLE_OK && segment.writer.offset != segment.writer.end) res = CURLE_PARTIAL_FILE;
+            if (metrics::enabled()) recordMetrics(handle, origin, res, httpCode);
+            if (segment.traceStartUs >= 0) {
+                trace::complete("segment", "http", segment.traceStartUs, trace::nowUs() - segment.traceStartUs,
+                                "\"range\":\"" + segment.range + "\",\"status\":" + std::to_string(httpCode) +
+                                ",\"curlcode\":" + std::to_string(res));
+            }
+            written += segment.writer.offset - segment.begin;
+
+            if (res == CURLE_OK) {
+                curl_off_t totalUs = 0;
+                curl_easy_getinfo(handle, CURLINFO_TOTAL_TIME_T, &totalUs);
+                if (totalUs > 0) {
+                    double bytesPerSecond = static_cast<double>(segment.writer.end - segment.begin) * 1e6 / static_cast<double>(totalUs);
+                    curl_off_t adapted = static_cast<curl_off_t>(bytesPerSecond * targetSegmentSeconds);
+                    segmentSize = std::clamp(adapted, minSegmentBytes, maxSegment);
+                }
+            } else if (segment.failures + 1 >= attempts) {
+                failure = Error{Error::Kind::TRANSPORT, res, httpCode,
+                                "Segment " + segment.range + " failed after " + std::to_string(attempts) +
+                                " attempt(s): " + curl_easy_strerror(res)};
+            } else {
+                // keep what arrived and fetch only the rest of the range
+                metrics::recordRetry(origin);
+                retries.push_back(Range{segment.writer.offset, segment.writer.end, segment.failures + 1});
+                attempt = std::max(attempt, segment.failures + 2);
+            }
+        }
 
-            std::cerr << "Retry attempt " << attempt << " failed. Retrying in " << delayMs << "ms...\n";
+        launch();
 
-            waitMs(delayMs);
+        if (progressCallback && progressCallback(size, written, 0, 0)) {
+            failure = Error{Error::Kind::TRANSPORT, CURLE_ABORTED_BY_CALLBACK, 0,
+                            "Curl perform failed on attempt " + std::to_string(attempt) + ": " +
+                                curl_easy_strerror(CURLE_ABORTED_BY_CALLBACK)};
         }
+        if (!failure && (!active.empty() || !delayed.empty())) {
+            // also sleeps until the next delayed start when nothing is in flight
+            int events = 0;
+            int sliceMs = idleHungry ? std::min<int>(timeoutMs, detail::idleSliceMs) : timeoutMs;
+            detail::BlockedScope blocked(Blocked::Transfer);
+            curl_multi_poll(multi.get(), nullptr, 0, sliceMs, &events);
+            if (events == 0 && idleHungry) idleHungry = detail::idleHook();
+        }
+    }
+
+    for (auto& entry : active) curl_multi_remove_handle(multi.get(), entry.first);
+    permit.breaker = nullptr;
+    if (breaker) {
+        if (failure) breaker->recordFailure();
+        else breaker->recordSuccess();
+    }
+    if (failure) {
+        // never leave a full-size file with holes that looks complete
+        int truncated = ::ftruncate(fd, 0);
+        (void)truncated; // the transfer error is what gets reported
+        return *failure;
     }
+    return Result<Response, Error>(std::move(response));
+}
 
-    // Should never be reached
-    throw LogicException("Retry logic terminated unexpectedly");
+inline Response Request::send(unsigned attempts) {
+    auto result = trySend(attempts);
+    if (!result) {
+        const Error& error = result.error();
+        if (error.kind == Error::Kind::CIRCUIT_OPEN) throw CircuitOpenException(error.message);
+        throw RequestException(error.message);
+    }
+    return std::move(result).value();
 }
 
 inline void Request::reset() {
@@ -784,6 +3603,7 @@ inline void Request::reset() {
     if (!curlHandle) {
         throw InitializationException("Curl re-initialization failed");
     }
+    attachConnectionCache();
 
     mime.reset();
     list.reset();
@@ -795,6 +3615,15 @@ inline void Request::reset() {
     progressCallback = nullptr;
     cookieFile.clear();
     cookieJar.clear();
+    rateLimiter.reset();
+    rateLimitKey.clear();
+    segments = 1;
+    minSegmentBytes = 1 << 20;
+    resume = false;
+    sink.reset();
+    bodySource.reset();
+    bodyView = {};
+    bodyOwner.reset();
 
     method = Method::GET;
     curl_easy_setopt(curlHandle.get(), CURLOPT_HTTPGET, 1L);
@@ -809,6 +3638,11 @@ inline void Request::clean() noexcept {
     curlHandle.reset();
 }
 
+inline void Request::attachConnectionCache() {
+    connectionCache = detail::connectionCache;
+    if (connectionCache) curl_easy_setopt(curlHandle.get(), CURLOPT_SHARE, connectionCache->get());
+}
+
 inline void Request::updateURL() {
     std::string s = args.empty() ? url : url + "?" + args;
     curl_easy_setopt(curlHandle.get(), CURLOPT_URL, s.c_str());
@@ -909,6 +3743,42 @@ inline Request& Request::enableVerbose(bool enabled){
     return *this;
 }
 
+inline Request& Request::setRateLimiter(std::shared_ptr<RateLimiter> limiter){
+    rateLimiter = std::move(limiter);
+    return *this;
+}
+
+inline Request& Request::setRateLimitKey(const std::string& key){
+    rateLimitKey = key;
+    return *this;
+}
+
+inline Request& Request::setSink(std::shared_ptr<Sink> s){
+    sink = std::move(s);
+    return *this;
+}
+
+inline Request& Request::setResume(bool enabled){
+    resume = enabled;
+    return *this;
+}
+
+inline Request& Request::setSegments(unsigned count, curl_off_t minSegment){
+    if (count == 0 || count > 64 || minSegment <= 0) {
+        throw LogicException("Segment count must be between 1 and 64 and the minimum segment size positive");
+    }
+    segments = count;
+    minSegmentBytes = minSegment;
+    return *this;
+}
+
+inline std::shared_ptr<RateLimiter> Request::resolveRateLimiter() const {
+    if (rateLimiter) return rateLimiter;
+    if (!detail::hasRateLimiters) return nullptr;
+    if (!rateLimitKey.empty()) return findRateLimiter(rateLimitKey);
+    return findRateLimiter(detail::urlHost(url));
+}
+
 
 inline Request& Request::setHttpVersion(HttpVersion version) {
     
@@ -933,7 +3803,8 @@ inline Request& Request::setHttpVersion(HttpVersion version) {
     return *this;
 }
 
-inline void Request::prepareCurlOptions(Response& response, FilePtr& fileOut, std::ostringstream& responseStream) {
+inline bool Request::prepareCurlOptions(Response& response, FilePtr& fileOut, std::shared_ptr<Sink>& output,
+                                        detail::ResumeState& resumeState) {
     // Set progress callback if defined
     if (progressCallback) {
         curl_easy_setopt(curlHandle.get(), CURLOPT_XFERINFOFUNCTION, detail::ProgressCallbackBridge);
@@ -943,22 +3814,96 @@ inline void Request::prepareCurlOptions(Response& response, FilePtr& fileOut, st
         curl_easy_setopt(curlHandle.get(), CURLOPT_NOPROGRESS, 1L);
     }
 
-    // Set output destination (file or memory stream)
-    if (!downloadFilePath.empty()) {
-        fileOut.reset(std::fopen(downloadFilePath.c_str(), "wb"));
+    // Set output destination (custom sink, resumable file, file or memory)
+    if (sink) {
+        output = sink;
+        curl_easy_setopt(curlHandle.get(), CURLOPT_WRITEFUNCTION, detail::SinkWriteCallback);
+        curl_easy_setopt(curlHandle.get(), CURLOPT_WRITEDATA, output.get());
+    } else if (!downloadFilePath.empty() && resume) {
+        // keep the bytes already on disk; "r+b" fails if the file does not exist yet
+        fileOut.reset(std::fopen(downloadFilePath.c_str(), "r+b"));
+        if (!fileOut) fileOut.reset(std::fopen(downloadFilePath.c_str(), "w+b"));
         if (!fileOut) {
-            throw RequestException("Failed to open file for writing: " + downloadFilePath);
+            return false;
+        }
+        resumeState.sidecarPath = downloadFilePath + ".curling";
+        resumeState.url = args.empty() ? url : url + "?" + args;
+        resumeState.file = fileOut.get();
+        resumeState.handle = curlHandle.get();
+        resumeState.headers = &(response.headers);
+        std::string storedUrl, validator;
+        if (detail::readResumeSidecar(resumeState.sidecarPath, storedUrl, validator) && storedUrl == resumeState.url) {
+            resumeState.validator = validator;
         }
-        curl_easy_setopt(curlHandle.get(), CURLOPT_WRITEFUNCTION, nullptr);
-        curl_easy_setopt(curlHandle.get(), CURLOPT_WRITEDATA, fileOut.get());
+        curl_easy_setopt(curlHandle.get(), CURLOPT_WRITEFUNCTION, detail::ResumeWriteCallback);
+        curl_easy_setopt(curlHandle.get(), CURLOPT_WRITEDATA, &resumeState);
     } else {
-        curl_easy_setopt(curlHandle.get(), CURLOPT_WRITEFUNCTION, detail::WriteCallback);
-        curl_easy_setopt(curlHandle.get(), CURLOPT_WRITEDATA, &responseStream);
+        if (!downloadFilePath.empty()) output = std::make_shared<FileSink>(downloadFilePath);
+        else output = std::make_shared<MemorySink>();
+        curl_easy_setopt(curlHandle.get(), CURLOPT_WRITEFUNCTION, detail::SinkWriteCallback);
+        curl_easy_setopt(curlHandle.get(), CURLOPT_WRITEDATA, output.get());
+    }
+
+    // Point libcurl at the body in place; the explicit size keeps NUL bytes (streamed bodies are set per attempt)
+    if (!bodySource && (method == Method::POST || method == Method::PUT || method == Method::PATCH)) {
+        std::string_view data = bodyOwner ? bodyView : std::string_view(body);
+        curl_easy_setopt(curlHandle.get(), CURLOPT_POSTFIELDSIZE_LARGE, static_cast<curl_off_t>(data.size()));
+        curl_easy_setopt(curlHandle.get(), CURLOPT_POSTFIELDS, data.data());
     }
 
     // Set header callback
     curl_easy_setopt(curlHandle.get(), CURLOPT_HEADERFUNCTION, detail::HeaderCallback);
     curl_easy_setopt(curlHandle.get(), CURLOPT_HEADERDATA, &(response.headers));
+    return true;
+}
+
+inline void Request::beginResumeAttempt(detail::ResumeState& state) {
+    std::fflush(state.file);
+    curl_off_t have = 0;
+    if (fseeko(state.file, 0, SEEK_END) == 0) have = ftello(state.file);
+    state.offset = state.validator.empty() ? 0 : std::max<curl_off_t>(have, 0);
+    state.status = 0;
+    if (state.offset == 0) {
+        // unknown or unvalidated content: start over
+        int truncated = ::ftruncate(fileno(state.file), 0);
+        (void)truncated; // a 200 response truncates again before writing
+        fseeko(state.file, 0, SEEK_SET);
+    }
+    // CURLOPT_RANGE rather than RESUME_FROM: libcurl must accept a 200 when If-Range does not match
+    std::string range = std::to_string(state.offset) + "-";
+    curl_easy_setopt(curlHandle.get(), CURLOPT_RANGE, state.offset > 0 ? range.c_str() : nullptr);
+
+    // If-Range is added to a per-attempt copy of the user's headers: the validator can change between attempts
+    state.requestHeaders.reset();
+    if (state.offset > 0) {
+        for (curl_slist* item = list.get(); item; item = item->next) {
+            detail::appendHeader(state.requestHeaders, item->data);
+        }
+        detail::appendHeader(state.requestHeaders, "If-Range: " + state.validator);
+        curl_easy_setopt(curlHandle.get(), CURLOPT_HTTPHEADER, state.requestHeaders.get());
+    } else {
+        curl_easy_setopt(curlHandle.get(), CURLOPT_HTTPHEADER, list.get());
+    }
+}
+
+inline bool Request::beginUpload() {
+    if (!bodySource->begin()) return false;
+    // the size is only known once the source is open, and may change between attempts
+    const curl_off_t size = bodySource->size();
+    CURL* handle = curlHandle.get();
+    curl_easy_setopt(handle, CURLOPT_POSTFIELDS, nullptr);
+    curl_easy_setopt(handle, CURLOPT_READFUNCTION, detail::SourceReadCallback);
+    curl_easy_setopt(handle, CURLOPT_READDATA, bodySource.get());
+    curl_easy_setopt(handle, CURLOPT_SEEKFUNCTION, detail::SourceSeekCallback);
+    curl_easy_setopt(handle, CURLOPT_SEEKDATA, bodySource.get());
+    if (method == Method::POST) {
+        curl_easy_setopt(handle, CURLOPT_POSTFIELDSIZE_LARGE, size);
+    } else {
+        // UPLOAD sends the read callback's data; CUSTOMREQUEST still names the method
+        curl_easy_setopt(handle, CURLOPT_UPLOAD, 1L);
+        curl_easy_setopt(handle, CURLOPT_INFILESIZE_LARGE, size);
+    }
+    return true;
 }
 
 inline void Request::setCurlHttpVersion() {
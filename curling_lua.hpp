@@ -0,0 +1,614 @@
+#pragma once
+
+#include <climits>
+#include <sol/sol.hpp>
+#include "curling.hpp"
+#include "lua_allocator.hpp"
+#include "profiler.hpp"
+
+inline curling::CircuitBreaker::Config circuit_config(const sol::optional<sol::table>& options) {
+    curling::CircuitBreaker::Config config;
+    if (!options) return config;
+    const sol::table& t = *options;
+    config.failureRateThreshold = t.get_or("threshold", config.failureRateThreshold);
+    config.minimumCalls = t.get_or("minimumCalls", config.minimumCalls);
+    config.windowSize = t.get_or("windowSize", config.windowSize);
+    config.openDuration = std::chrono::milliseconds(t.get_or("openMs", static_cast<long long>(config.openDuration.count())));
+    config.halfOpenProbes = t.get_or("probes", config.halfOpenProbes);
+    config.countServerErrors = t.get_or("countServerErrors", config.countServerErrors);
+    return config;
+}
+
+// Streams the response body into a Lua function, one chunk per call; returning false aborts.
+class LuaSink : public curling::Sink {
+public:
+    explicit LuaSink(sol::main_protected_function fn) : fn(std::move(fn)) {}
+
+    bool write(const char* data, size_t length) override {
+        sol::protected_function_result res = fn(std::string_view(data, length));
+        if (!res.valid()) {
+            sol::error err = res;
+            errorMessage = err.what();
+            return false;
+        }
+        sol::optional<bool> keepGoing = res;
+        if (keepGoing && !*keepGoing) {
+            errorMessage = "Response body rejected by callback";
+            return false;
+        }
+        return true;
+    }
+
+private:
+    sol::main_protected_function fn;
+};
+
+// Pulls the request body from a Lua function returning string chunks, then nil at the end.
+// A generator cannot rewind, so the body is sent once: retries fail instead of sending a partial body.
+class LuaSource : public curling::BodySource {
+public:
+    LuaSource(sol::main_protected_function fn, curl_off_t length) : fn(std::move(fn)), length(length) {}
+
+    bool begin() override {
+        if (started) {
+            errorMessage = "A generator body cannot be sent twice";
+            return false;
+        }
+        started = true;
+        return true;
+    }
+
+    bool read(char* buffer, size_t capacity, size_t& count) override {
+        count = 0;
+        while (offset == pending.size() && !finished) {
+            sol::protected_function_result res = fn();
+            if (!res.valid()) {
+                sol::error err = res;
+                errorMessage = err.what();
+                return false;
+            }
+            sol::optional<std::string> chunk = res;
+            pending = chunk ? std::move(*chunk) : std::string();
+            finished = !chunk;
+            offset = 0;
+        }
+        count = std::min(capacity, pending.size() - offset);
+        std::memcpy(buffer, pending.data() + offset, count);
+        offset += count;
+        return true;
+    }
+
+    curl_off_t size() const override { return length; }
+
+private:
+    sol::main_protected_function fn;
+    curl_off_t length;
+    std::string pending;
+    size_t offset = 0;
+    bool started = false;
+    bool finished = false;
+};
+
+// Response as seen from Lua. The body moves into shared Buffer storage, so views and slices
+// do not copy it, and res.body creates the Lua string once and caches it.
+struct LuaResponse {
+    explicit LuaResponse(curling::Response&& res)
+        : response(std::move(res)), body(std::move(response.body)) {}
+
+    curling::Response response; // everything but the body
+    curling::Buffer body;
+    sol::reference text;        // res.body, once materialized
+
+    void release() {
+        body.clear();
+        text = sol::reference();
+    }
+};
+
+// The collector only sees the small userdata, not the native body behind it. Charging the
+// body size as GC debt makes it collect big responses as if they were Lua allocations.
+inline LuaResponse to_lua(lua_State* L, curling::Response&& res) {
+    const size_t kb = res.body.size() >> 10;
+    if (kb > 0) lua_gc(L, LUA_GCSTEP, static_cast<int>(std::min<size_t>(kb, INT_MAX)));
+    return LuaResponse(std::move(res));
+}
+
+// Appends strings, numbers and Buffers to a Buffer, like a table.concat without the table.
+inline void buffer_append(curling::Buffer& buffer, const sol::variadic_args& values) {
+    for (const auto& value : values) {
+        if (value.is<curling::Buffer>()) {
+            buffer.append(value.as<curling::Buffer&>());
+        } else if (value.get_type() == sol::type::string || value.get_type() == sol::type::number) {
+            size_t length = 0;
+            const char* bytes = lua_tolstring(value.lua_state(), value.stack_index(), &length);
+            buffer.append(std::string_view(bytes, length));
+        } else {
+            throw curling::LogicException("Buffer can only append strings, numbers and Buffers");
+        }
+    }
+}
+
+// buf:slice(i, j) with string.sub's rules for negative and out-of-range positions.
+inline curling::Buffer buffer_slice(const curling::Buffer& buffer, long long i, sol::optional<long long> j) {
+    const long long n = static_cast<long long>(buffer.size());
+    long long first = i < 0 ? std::max(n + i + 1, 1LL) : std::max(i, 1LL);
+    long long last = j.value_or(-1);
+    last = last < 0 ? n + last + 1 : std::min(last, n);
+    if (first > last) return curling::Buffer();
+    return buffer.slice(static_cast<size_t>(first - 1), static_cast<size_t>(last - first + 1));
+}
+
+// The allocator behind a state, if it was created with lua_allocator::Allocator.
+inline const lua_allocator::Allocator* state_allocator(lua_State* L) {
+    void* ud = nullptr;
+    lua_Alloc alloc = lua_getallocf(L, &ud);
+    return alloc == &lua_allocator::Allocator::allocate ? static_cast<const lua_allocator::Allocator*>(ud) : nullptr;
+}
+
+// Collector work done while requests wait on the network (curling.gc{idle = true}).
+struct IdleCollector {
+    lua_State* L = nullptr; ///< main thread of the state being collected, cleared when it closes
+    bool generational = false;
+    uint64_t steps = 0;
+    uint64_t cycles = 0;
+
+    // one basic step per idle slice until a cycle completes; generational mode does one minor collection
+    bool step() {
+        if (!L || !lua_gc(L, LUA_GCISRUNNING)) return false;
+        ++steps;
+        bool finished = lua_gc(L, LUA_GCSTEP, 0) != 0;
+        if (finished) ++cycles;
+        return !finished && !generational;
+    }
+};
+
+inline thread_local IdleCollector idleCollector;
+
+// Stores a registry object under key whose finalizer, onClose, runs when the state is closed;
+// does nothing if one is already there.
+inline void install_close_hook(lua_State* main, const char* key, lua_CFunction onClose) {
+    if (lua_getfield(main, LUA_REGISTRYINDEX, key) != LUA_TNIL) {
+        lua_pop(main, 1);
+        return;
+    }
+    lua_pop(main, 1);
+    lua_newuserdatauv(main, 0, 0);
+    lua_createtable(main, 0, 1);
+    lua_pushcfunction(main, onClose);
+    lua_setfield(main, -2, "__gc");
+    lua_setmetatable(main, -2);
+    lua_setfield(main, LUA_REGISTRYINDEX, key);
+}
+
+// The idle hook must never step a state after lua_close.
+inline int idle_collector_closed(lua_State* L) {
+    if (idleCollector.L == sol::main_thread(L, L)) {
+        idleCollector.L = nullptr;
+        curling::setIdleHook(nullptr);
+    }
+    return 0;
+}
+
+// Async transfers hold references to Lua callbacks and bodies: drop the unfinished ones
+// before the state that owns them is gone. The event loop belongs to the thread, so this
+// also drops those of any other state the thread runs.
+inline int pending_transfers_closed(lua_State*) {
+    curling::cancelPending();
+    return 0;
+}
+
+// curling.gc{mode = "incremental"|"generational", pause, stepmul, stepsize, minormul, majormul, idle}
+// applies a collector policy and returns the current one with the idle step counters.
+inline sol::table gc_policy(sol::optional<sol::table> options, sol::this_state s) {
+    lua_State* L = s;
+    if (options) {
+        const sol::table& t = *options;
+        std::string mode = t.get_or<std::string>("mode", idleCollector.generational ? "generational" : "incremental");
+        if (mode == "generational") {
+            lua_gc(L, LUA_GCGEN, t.get_or("minormul", 0), t.get_or("majormul", 0));
+            idleCollector.generational = true;
+        } else if (mode == "incremental") {
+            lua_gc(L, LUA_GCINC, t.get_or("pause", 0), t.get_or("stepmul", 0), t.get_or("stepsize", 0));
+            idleCollector.generational = false;
+        } else {
+            throw curling::LogicException("Unknown GC mode: " + mode);
+        }
+        if (sol::optional<bool> idle = t["idle"]) {
+            if (*idle) {
+                idleCollector.L = sol::main_thread(L, L);
+                install_close_hook(idleCollector.L, "curling.gc.idle.sentinel", idle_collector_closed);
+                curling::setIdleHook([] { return idleCollector.step(); });
+            } else {
+                idleCollector.L = nullptr;
+                curling::setIdleHook(nullptr);
+            }
+        }
+    }
+    sol::state_view lua(L);
+    return lua.create_table_with(
+        "mode", idleCollector.generational ? "generational" : "incremental",
+        "idle", idleCollector.L != nullptr && static_cast<bool>(curling::detail::idleHook),
+        "idleSteps", idleCollector.steps,
+        "idleCycles", idleCollector.cycles);
+}
+
+// Setters return their own userdata instead of a new non-owning reference, so the object made by
+// Request.new() in Request.new():setURL(url):send() is not garbage while the send runs Lua code
+// (idle collector steps, sinks, async callbacks).
+template <typename F>
+auto chained(F&& setter) {
+    return sol::policies(std::forward<F>(setter), sol::returns_self());
+}
+
+// Registers the bindings and returns the curling table. With globals (the luaCurling executable)
+// the types and helpers are globals and the table is the global `curling`; without (luaopen_curling)
+// everything lives in the returned table only.
+inline sol::table register_curling(sol::state_view lua, bool globals = true) {
+    using namespace curling;
+
+    sol::table module = globals ? lua.create_named_table("curling") : lua.create_table();
+    sol::table ns = globals ? sol::table(lua.globals()) : module;
+    install_close_hook(sol::main_thread(lua.lua_state(), lua.lua_state()), "curling.async.sentinel", pending_transfers_closed);
+
+    ns.new_enum<Request::Method>("HttpMethod", {
+        {"GET", Request::Method::GET},
+        {"POST", Request::Method::POST},
+        {"PUT", Request::Method::PUT},
+        {"DELETE", Request::Method::DEL},
+        {"PATCH", Request::Method::PATCH},
+        {"HEAD", Request::Method::HEAD},
+        {"MIME", Request::Method::MIME}
+    });
+
+    ns.new_enum<Request::HttpVersion>("HttpVersion", {
+        {"DEFAULT", Request::HttpVersion::DEFAULT},
+        {"HTTP_1_1", Request::HttpVersion::HTTP_1_1},
+        {"HTTP_2", Request::HttpVersion::HTTP_2},
+        {"HTTP_3", Request::HttpVersion::HTTP_3}
+    });
+
+    ns.new_usertype<LuaResponse>("Response",
+        sol::no_constructor,
+        "httpCode", sol::property([](const LuaResponse& res) { return res.response.httpCode; }),
+        "headers", sol::property([](LuaResponse& res) -> std::map<std::string, std::vector<std::string>>& {
+            return res.response.headers;
+        }),
+        "body", sol::property([](LuaResponse& res, sol::this_state s) {
+            if (!res.text.valid()) res.text = sol::make_reference(s, res.body.view());
+            return res.text;
+        }),
+        // Buffer sharing the body's storage; like any Buffer copy, modifying it copies first
+        "view", [](const LuaResponse& res) { return res.body; },
+        "toString", [](const LuaResponse& res) {
+            Response copy = res.response;
+            copy.body = res.body.str();
+            return copy.toString();
+        },
+        "getHeader", [](const LuaResponse& res, const std::string& key) { return res.response.getHeader(key); },
+        // frees the body now instead of at the next collection; views taken earlier stay valid
+        "release", &LuaResponse::release
+    );
+
+    // positions are 1-based and inclusive, like string.sub and string.find
+    ns.new_usertype<Buffer>("Buffer",
+        sol::factories(
+            [] { return Buffer(); },
+            [](const std::string& bytes) { return Buffer(bytes); }
+        ),
+        "append", [](Buffer& buffer, sol::variadic_args values) -> Buffer& {
+            buffer_append(buffer, values);
+            return buffer;
+        },
+        "format", [](Buffer& buffer, sol::this_state s, sol::variadic_args values) -> Buffer& {
+            sol::state_view lua(s);
+            sol::protected_function format = lua["string"]["format"];
+            sol::protected_function_result res = format(values);
+            if (!res.valid()) {
+                sol::error err = res;
+                throw LogicException(err.what());
+            }
+            buffer.append(res.get<std::string_view>());
+            return buffer;
+        },
+        "reserve", [](Buffer& buffer, size_t capacity) -> Buffer& {
+            buffer.reserve(capacity);
+            return buffer;
+        },
+        "clear", [](Buffer& buffer) -> Buffer& {
+            buffer.clear();
+            return buffer;
+        },
+        "size", &Buffer::size,
+        "len", &Buffer::size,
+        "slice", &buffer_slice,
+        "sub", &buffer_slice,
+        "byte", [](const Buffer& buffer, sol::optional<long long> i) -> sol::optional<int> {
+            long long pos = i.value_or(1);
+            if (pos < 0) pos += static_cast<long long>(buffer.size()) + 1;
+            if (pos < 1 || pos > static_cast<long long>(buffer.size())) return sol::nullopt;
+            return static_cast<unsigned char>(buffer.view()[static_cast<size_t>(pos - 1)]);
+        },
+        // for line in buf:lines() do ... end, without the line terminators, like file:lines()
+        "lines", [](const Buffer& buffer) {
+            return [buffer, pos = size_t(0)]() mutable -> sol::optional<std::string_view> {
+                std::string_view rest = buffer.view().substr(std::min(pos, buffer.size()));
+                if (rest.empty()) return sol::nullopt;
+                size_t end = rest.find('\n');
+                std::string_view line = rest.substr(0, end);
+                pos += end == std::string_view::npos ? rest.size() : end + 1;
+                return line;
+            };
+        },
+        "find", [](const Buffer& buffer, std::string_view needle, sol::optional<long long> init,
+                   sol::this_state s) -> std::tuple<sol::object, sol::object> {
+            long long from = init.value_or(1);
+            if (from < 0) from = std::max(static_cast<long long>(buffer.size()) + from + 1, 1LL);
+            size_t pos = from < 1 ? 0 : static_cast<size_t>(from - 1);
+            pos = pos > buffer.size() ? std::string_view::npos : buffer.find(needle, pos);
+            if (pos == std::string_view::npos) return {sol::lua_nil, sol::lua_nil};
+            return {sol::make_object(s, pos + 1), sol::make_object(s, pos + needle.size())};
+        },
+        "tostring", [](const Buffer& buffer) { return buffer.view(); },
+        sol::meta_function::to_string, [](const Buffer& buffer) { return buffer.view(); },
+        sol::meta_function::length, &Buffer::size
+    );
+
+    ns.new_enum<Error::Kind>("ErrorKind", {
+        {"TRANSPORT", Error::Kind::TRANSPORT},
+        {"CIRCUIT_OPEN", Error::Kind::CIRCUIT_OPEN},
+        {"FILE", Error::Kind::FILE}
+    });
+
+    ns.new_usertype<Error>("Error",
+        sol::no_constructor,
+        "kind", sol::readonly(&Error::kind),
+        "code", sol::property([](const Error& e) { return static_cast<int>(e.code); }),
+        "httpCode", sol::readonly(&Error::httpCode),
+        "message", sol::readonly(&Error::message),
+        "toString", &Error::toString,
+        sol::meta_function::to_string, &Error::toString
+    );
+
+    ns.new_usertype<Request>("Request",
+        sol::constructors<Request()>(),
+
+        "setMethod", chained(&Request::setMethod),
+        "setURL", chained(&Request::setURL),
+        "addHeader", chained(&Request::addHeader),
+        "setBody", chained([](Request& req, sol::stack_object body) -> Request& {
+            if (body.is<Buffer>()) return req.setBody(body.as<Buffer&>());
+            if (body.get_type() != sol::type::string) throw LogicException("setBody expects a string or Buffer");
+            // point at the Lua string's own bytes and keep it referenced until the request is sent;
+            // anchored in the main thread, since sendAsync may outlive a calling coroutine
+            auto data = body.as<std::string_view>();
+            return req.setBody(data, std::make_shared<sol::main_reference>(body));
+        }),
+        "send", [](Request& req, sol::optional<unsigned> attempts, sol::this_state s) {
+            return to_lua(s, req.send(attempts.value_or(1)));
+        },
+        "trySend", [](Request& req, sol::optional<unsigned> attempts, sol::this_state s) {
+            // Returns res, nil on success and nil, err on failure, without raising.
+            auto result = req.trySend(attempts.value_or(1));
+            if (result) {
+                return std::make_tuple(sol::make_object(s, to_lua(s, std::move(result).value())),
+                                       sol::make_object(s, sol::lua_nil));
+            }
+            return std::make_tuple(sol::make_object(s, sol::lua_nil), sol::make_object(s, std::move(result).error()));
+        },
+        "sendAsync", [](Request& req, sol::main_protected_function callback, sol::optional<unsigned> attempts,
+                        sol::this_state s) {
+            // callback(res, nil) or callback(nil, err) runs from curling.poll, curling.run or the REPL,
+            // on the main thread: the coroutine that called sendAsync may be gone by then.
+            lua_State* L = sol::main_thread(s, s);
+            req.sendAsync([L, callback = std::move(callback)](Result<Response, Error> result) {
+                sol::protected_function_result r = result
+                    ? callback(to_lua(L, std::move(result).value()), sol::lua_nil)
+                    : callback(sol::lua_nil, std::move(result).error());
+                if (!r.valid()) {
+                    sol::error err = r;
+                    throw err;
+                }
+            }, attempts.value_or(1));
+        },
+        "reset", &Request::reset,
+        "setTimeout", chained(&Request::setTimeout),
+        "setConnectTimeout", chained(&Request::setConnectTimeout),
+        "setFollowRedirects", chained(&Request::setFollowRedirects),
+        "setUserAgent", chained(&Request::setUserAgent),
+        "setHttpVersion", chained(&Request::setHttpVersion),
+        "addArg", chained(&Request::addArg),
+        "setAuthToken", chained(&Request::setAuthToken),
+        "downloadToFile", chained(&Request::downloadToFile),
+        "setCookiePath", chained(&Request::setCookiePath),
+        "addFormField", chained(&Request::addFormField),
+        "addFormFile", chained(&Request::addFormFile),
+        "enableVerbose", chained(&Request::enableVerbose),
+        "setProxy", chained(&Request::setProxy),
+        "setProxyAuth", chained(&Request::setProxyAuth),
+        "setProxyAuthMethod", chained(&Request::setProxyAuthMethod),
+        "setHttpAuth", chained(&Request::setHttpAuth),
+        "setHttpAuthMethod", chained(&Request::setHttpAuthMethod),
+        "setHttpVersion", chained(&Request::setHttpVersion),
+        "setRateLimiter", chained(&Request::setRateLimiter),
+        "setRateLimitKey", chained(&Request::setRateLimitKey),
+        "setResume", chained([](Request& req, sol::optional<bool> enabled) -> Request& {
+            return req.setResume(enabled.value_or(true));
+        }),
+        "setSegments", chained([](Request& req, unsigned count, sol::optional<curl_off_t> minSegmentBytes) -> Request& {
+            return req.setSegments(count, minSegmentBytes.value_or(1 << 20));
+        }),
+        "setBodySource", chained([](Request& req, sol::optional<BodySource&> source) -> Request& {
+            return req.setBodySource(source ? source->shared_from_this() : nullptr);
+        }),
+        "setSink", chained([](Request& req, sol::optional<Sink&> sink) -> Request& {
+            return req.setSink(sink ? sink->shared_from_this() : nullptr);
+        })
+    );
+
+    ns.new_usertype<BodySource>("BodySource",
+        sol::no_constructor,
+        "size", &BodySource::size,
+        "error", &BodySource::error
+    );
+    ns.new_usertype<MemorySource>("MemorySource", sol::no_constructor, sol::base_classes, sol::bases<BodySource>());
+    ns.new_usertype<FileSource>("FileSource", sol::no_constructor, sol::base_classes, sol::bases<BodySource>());
+    ns.new_usertype<LuaSource>("GeneratorSource", sol::no_constructor, sol::base_classes, sol::bases<BodySource>());
+
+    ns.new_usertype<Sink>("Sink",
+        sol::no_constructor,
+        "error", &Sink::error
+    );
+    ns.new_usertype<MemorySink>("MemorySink",
+        sol::no_constructor,
+        sol::base_classes, sol::bases<Sink>(),
+        "body", &MemorySink::body
+    );
+    ns.new_usertype<FileSink>("FileSink", sol::no_constructor, sol::base_classes, sol::bases<Sink>());
+    ns.new_usertype<DiscardSink>("DiscardSink",
+        sol::no_constructor,
+        sol::base_classes, sol::bases<Sink>(),
+        "bytes", &DiscardSink::bytes
+    );
+    ns.new_usertype<TeeSink>("TeeSink", sol::no_constructor, sol::base_classes, sol::bases<Sink>());
+    ns.new_usertype<DigestSink>("DigestSink",
+        sol::no_constructor,
+        sol::base_classes, sol::bases<Sink>(),
+        "hex", &DigestSink::hex,
+        "bytes", &DigestSink::bytes
+    );
+    ns.new_usertype<FdSink>("FdSink", sol::no_constructor, sol::base_classes, sol::bases<Sink>());
+    ns.new_usertype<PipeSink>("PipeSink", sol::no_constructor, sol::base_classes, sol::bases<Sink>());
+    ns.new_usertype<LuaSink>("CallbackSink", sol::no_constructor, sol::base_classes, sol::bases<Sink>());
+
+    ns.new_usertype<RateLimiter>("RateLimiter",
+        sol::factories([](double rate, sol::optional<unsigned> burst) {
+            return std::make_shared<RateLimiter>(rate, burst.value_or(1));
+        }),
+        "tryAcquire", &RateLimiter::tryAcquire,
+        "acquire", &RateLimiter::acquire,
+        "rate", &RateLimiter::rate,
+        "burst", &RateLimiter::burst
+    );
+
+    ns.new_enum<CircuitBreaker::State>("CircuitState", {
+        {"CLOSED", CircuitBreaker::State::CLOSED},
+        {"OPEN", CircuitBreaker::State::OPEN},
+        {"HALF_OPEN", CircuitBreaker::State::HALF_OPEN}
+    });
+
+    ns.new_usertype<CircuitBreaker>("CircuitBreaker",
+        sol::no_constructor,
+        "state", &CircuitBreaker::state,
+        "reset", &CircuitBreaker::reset
+    );
+
+    module["rateLimit"] = [](const std::string& name, double rate, sol::optional<unsigned> burst) {
+        return defineRateLimiter(name, rate, burst.value_or(1));
+    };
+    module["getRateLimit"] = &curling::findRateLimiter;
+    module["removeRateLimit"] = &curling::removeRateLimiter;
+    module["circuitBreaker"] = [](const std::string& origin, sol::optional<sol::table> options) {
+        return configureCircuitBreaker(origin, circuit_config(options));
+    };
+    module["enableCircuitBreakers"] = [](sol::optional<sol::table> options) {
+        enableCircuitBreakers(circuit_config(options));
+    };
+    module["disableCircuitBreakers"] = &curling::disableCircuitBreakers;
+    module["getCircuitBreaker"] = &curling::findCircuitBreaker;
+
+    module["memorySink"] = [] { return std::make_shared<MemorySink>(); };
+    module["fileSink"] = [](const std::string& path, sol::optional<size_t> bufferSize) {
+        return std::make_shared<FileSink>(path, bufferSize.value_or(1 << 20));
+    };
+    module["discardSink"] = [] { return std::make_shared<DiscardSink>(); };
+    module["teeSink"] = [](Sink& first, Sink& second) {
+        return std::make_shared<TeeSink>(first.shared_from_this(), second.shared_from_this());
+    };
+    module["digestSink"] = [](sol::optional<std::string> algorithm) {
+        const std::string name = algorithm.value_or("sha256");
+        if (name == "sha256") return std::make_shared<DigestSink>(DigestSink::Algorithm::SHA256);
+        if (name == "xxh64") return std::make_shared<DigestSink>(DigestSink::Algorithm::XXH64);
+        throw LogicException("Unknown digest algorithm: " + name);
+    };
+    module["fdSink"] = [](int fd) { return std::make_shared<FdSink>(fd); };
+    module["pipeSink"] = [](const std::string& command) { return std::make_shared<PipeSink>(command); };
+    module["callbackSink"] = [](sol::main_protected_function fn) { return std::make_shared<LuaSink>(std::move(fn)); };
+
+    module["buffer"] = [](sol::variadic_args values) {
+        Buffer buffer;
+        buffer_append(buffer, values);
+        return buffer;
+    };
+    module["memorySource"] = [](std::string data) { return std::make_shared<MemorySource>(std::move(data)); };
+    module["fileSource"] = [](const std::string& path) { return std::make_shared<FileSource>(path); };
+    module["generatorSource"] = [](sol::main_protected_function fn, sol::optional<curl_off_t> size) {
+        return std::make_shared<LuaSource>(std::move(fn), size.value_or(-1));
+    };
+
+    // live/peak bytes and allocation counts of this Lua state, or nil with the default allocator
+    module["memory"] = [](sol::this_state s) -> sol::object {
+        const lua_allocator::Allocator* allocator = state_allocator(s);
+        if (!allocator) return sol::make_object(s, sol::lua_nil);
+        const lua_allocator::Stats& stats = allocator->stats();
+        sol::state_view lua(s);
+        return lua.create_table_with(
+            "live", stats.live,
+            "peak", stats.peak,
+            "allocations", stats.allocations,
+            "reallocations", stats.reallocations,
+            "frees", stats.frees,
+            "allocated", stats.allocated,
+            "reserved", stats.reserved,
+            "pooled", allocator->pooled());
+    };
+
+    module["gc"] = &gc_policy;
+
+    // poll(ms) runs async transfers for up to ms (default 0) and their due callbacks; returns how many ran
+    module["poll"] = [](sol::optional<long> timeoutMs) {
+        curling::poll(timeoutMs.value_or(0));
+        return curling::dispatch();
+    };
+    module["run"] = &curling::runPending;
+    module["pending"] = &curling::pending;
+
+    module["metrics"] = &curling::metrics::prometheus;
+    module["writeMetrics"] = &curling::metrics::writePrometheus;
+    module["resetMetrics"] = &curling::metrics::reset;
+
+    sol::table tracer = lua.create_table();
+    tracer["start"] = &curling::trace::start;
+    tracer["stop"] = &curling::trace::stop;
+    tracer["flush"] = &curling::trace::flush;
+    tracer["clear"] = &curling::trace::clear;
+    tracer["span"] = [](const std::string& name, sol::protected_function fn, sol::variadic_args args) {
+        trace::Span span(name, "lua");
+        sol::protected_function_result res = fn(args);
+        if (!res.valid()) {
+            sol::error err = res;
+            throw err;
+        }
+        return res;
+    };
+    module["trace"] = tracer;
+
+    // sampling profiler of the calling thread; samples are kept as folded stacks
+    sol::table sampling = lua.create_table();
+    sampling["start"] = [](sol::this_state s, sol::optional<double> intervalMs) {
+        const double ms = intervalMs.value_or(1.0);
+        if (!(ms > 0)) throw LogicException("profiler interval must be positive");
+        if (!profiler::sampler().start(s, std::chrono::microseconds(static_cast<std::int64_t>(ms * 1000)))) {
+            throw LogicException("profiler is already running");
+        }
+    };
+    sampling["stop"] = [] { profiler::sampler().stop(); };
+    sampling["running"] = [] { return profiler::sampler().running(); };
+    sampling["folded"] = [] { return profiler::sampler().folded(); };
+    sampling["flush"] = [](const std::string& path) { profiler::sampler().flush(path); };
+    sampling["clear"] = [] { profiler::sampler().clear(); };
+    module["profiler"] = sampling;
+
+    ns["curling_version"] = &curling::version;
+    ns["waitMS"] = &curling::waitMs;
+    return module;
+}
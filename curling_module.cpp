@@ -0,0 +1,10 @@
+// Entry point of curling.so, the bindings as a loadable Lua module:
+//   package.cpath = "/path/to/?.so;" .. package.cpath
+//   local curling = require "curling"
+// The host process provides Lua, so the module does not link it.
+#include "curling_lua.hpp"
+
+extern "C" int luaopen_curling(lua_State* L) {
+    sol::table module = register_curling(L, false);
+    return sol::stack::push(L, module);
+}
@@ -0,0 +1,417 @@
+#pragma once
+
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <sol/sol.hpp>
+#include "curling.hpp"
+#include "lua_allocator.hpp"
+#include "profiler.hpp"
+
+namespace daemon_mode {
+
+// === Wire format ===
+// Both directions exchange frames: a type byte, a 32-bit big-endian payload length, the payload.
+// client -> daemon: 'C' command-line chunk, 'S' script ("chunkname\0source"), 'A' argument, 'R' run
+// daemon -> client: 'O' stdout bytes, 'E' stderr bytes, 'X' exit status (one byte)
+constexpr uint32_t maxFrame = 64u << 20;
+// A client has this long to send its whole job, so idle connections cannot hold on to workers.
+constexpr std::chrono::seconds jobTimeout{10};
+
+using Deadline = std::chrono::steady_clock::time_point; // Deadline() waits forever
+
+// A script run: -e chunks, then the script with its arguments.
+struct Job {
+    std::vector<std::string> chunks;
+    std::string chunkname; // empty without a script
+    std::string script;
+    std::vector<std::string> args;
+};
+
+// LUACURLING_SOCKET, else $XDG_RUNTIME_DIR/luaCurling.sock, else /tmp/luaCurling-<uid>.sock
+inline std::string socket_path() {
+    if (const char* path = std::getenv("LUACURLING_SOCKET"); path && *path) return path;
+    if (const char* dir = std::getenv("XDG_RUNTIME_DIR"); dir && *dir) return std::string(dir) + "/luaCurling.sock";
+    return "/tmp/luaCurling-" + std::to_string(::getuid()) + ".sock";
+}
+
+// True if the process at the other end of a connected socket runs as this user. The socket
+// file's permissions are not enough: in /tmp, another user could have created it first.
+inline bool same_user(int fd) {
+    ucred peer{};
+    socklen_t size = sizeof(peer);
+    return ::getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &peer, &size) == 0 && peer.uid == ::getuid();
+}
+
+inline bool write_all(int fd, const char* p, size_t size) {
+    while (size > 0) {
+        ssize_t n = ::write(fd, p, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+inline bool read_all(int fd, char* p, size_t size, Deadline deadline = Deadline()) {
+    while (size > 0) {
+        if (deadline != Deadline()) {
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+            pollfd readable{fd, POLLIN, 0};
+            int ready = left.count() > 0 ? ::poll(&readable, 1, static_cast<int>(left.count()) + 1) : 0;
+            if (ready < 0 && errno == EINTR) continue;
+            if (ready <= 0) return false;
+        }
+        ssize_t n = ::read(fd, p, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// One write per frame, so frames from a stream are never interleaved with partial ones.
+inline bool send_frame(int fd, char type, std::string_view payload) {
+    std::string frame(5, '\0');
+    const auto size = static_cast<uint32_t>(payload.size());
+    frame[0] = type;
+    for (int i = 0; i < 4; ++i) frame[1 + i] = static_cast<char>(size >> (24 - 8 * i));
+    frame.append(payload);
+    return write_all(fd, frame.data(), frame.size());
+}
+
+inline bool read_frame(int fd, char& type, std::string& payload, Deadline deadline = Deadline()) {
+    unsigned char header[5];
+    if (!read_all(fd, reinterpret_cast<char*>(header), sizeof(header), deadline)) return false;
+    type = static_cast<char>(header[0]);
+    uint32_t size = 0;
+    for (int i = 1; i < 5; ++i) size = size << 8 | header[i];
+    if (size > maxFrame) return false;
+    payload.resize(size);
+    return read_all(fd, payload.data(), size, deadline);
+}
+
+inline bool send_job(int fd, const Job& job) {
+    for (const std::string& chunk : job.chunks) {
+        if (!send_frame(fd, 'C', chunk)) return false;
+    }
+    if (!job.chunkname.empty() && !send_frame(fd, 'S', job.chunkname + '\0' + job.script)) return false;
+    for (const std::string& arg : job.args) {
+        if (!send_frame(fd, 'A', arg)) return false;
+    }
+    return send_frame(fd, 'R', {});
+}
+
+inline bool read_job(int fd, Job& job, Deadline deadline = Deadline()) {
+    char type;
+    std::string payload;
+    while (read_frame(fd, type, payload, deadline)) {
+        switch (type) {
+        case 'C': job.chunks.push_back(std::move(payload)); break;
+        case 'A': job.args.push_back(std::move(payload)); break;
+        case 'S': {
+            size_t split = payload.find('\0');
+            if (split == std::string::npos) return false;
+            job.chunkname = payload.substr(0, split);
+            job.script = payload.substr(split + 1);
+            break;
+        }
+        case 'R': return true;
+        default: return false;
+        }
+    }
+    return false;
+}
+
+// === Thin client: runs a job on the daemon and relays its output ===
+// Returns the exit status of the script, or 1 when the daemon cannot be reached.
+inline int run_remote(const std::string& path, const Job& job) {
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+    if (fd < 0 || ::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        std::cerr << "luaCurling: no daemon at " << path << ": " << std::strerror(errno) << '\n';
+        if (fd >= 0) ::close(fd);
+        return 1;
+    }
+    if (!same_user(fd)) {
+        std::cerr << "luaCurling: the daemon at " << path << " is run by another user\n";
+        ::close(fd);
+        return 1;
+    }
+    int status = 1;
+    char type;
+    std::string payload;
+    bool done = false;
+    if (send_job(fd, job)) {
+        while (!done && read_frame(fd, type, payload)) {
+            if (type == 'O') write_all(STDOUT_FILENO, payload.data(), payload.size());
+            else if (type == 'E') write_all(STDERR_FILENO, payload.data(), payload.size());
+            else if (type == 'X' && payload.size() == 1) status = static_cast<unsigned char>(payload[0]), done = true;
+        }
+    }
+    ::close(fd);
+    if (!done) std::cerr << "luaCurling: the daemon closed the connection\n";
+    return status;
+}
+
+// Thrown through Lua by print and io.write when the client has gone away.
+struct ClientGone : std::runtime_error {
+    ClientGone() : std::runtime_error("client disconnected") {}
+};
+
+// Thrown through Lua by os.exit to end the job.
+struct ExitRequested : std::runtime_error {
+    ExitRequested() : std::runtime_error("os.exit") {}
+};
+
+// === A Lua state and a connection cache serving jobs one at a time ===
+// The state is reused between jobs: modules stay loaded and compiled, and the connections,
+// DNS answers and TLS sessions of earlier jobs are reused. Each job runs in its own _ENV,
+// falling back to the globals, so its globals do not leak into the next one. print, io.write,
+// io.stdout and io.stderr stream back to the client; os.exit ends the job, not the daemon.
+class Worker {
+public:
+    using Setup = std::function<void(sol::state&)>;
+
+    Worker(bool pooledAllocator, const Setup& setup)
+        : allocator_(pooledAllocator),
+          lua_(sol::default_at_panic, &lua_allocator::Allocator::allocate, &allocator_) {
+        setup(lua_);
+    }
+
+    void serve(int fd) {
+        Job job;
+        if (!read_job(fd, job, std::chrono::steady_clock::now() + jobTimeout)) return; // dropped by the caller
+        fd_ = fd;
+        exitStatus_ = -1;
+        int status = run(job);
+        lua_gc(lua_, LUA_GCSTEP, 0); // pay some of this job's garbage before the next one
+        send_frame(fd, 'X', std::string(1, static_cast<char>(status)));
+        fd_ = -1;
+    }
+
+private:
+    lua_allocator::Allocator allocator_; // declared before lua_: must outlive it
+    sol::state lua_;
+    int fd_ = -1;
+    int exitStatus_ = -1; // set by os.exit
+
+    void output(char type, const sol::variadic_args& values, const char* separator, const char* end) {
+        std::string text;
+        bool first = true;
+        for (const sol::stack_proxy& value : values) {
+            if (!first) text += separator;
+            first = false;
+            size_t length = 0;
+            const char* s = luaL_tolstring(value.lua_state(), value.stack_index(), &length);
+            text.append(s, length);
+            lua_pop(value.lua_state(), 1);
+        }
+        text += end;
+        if (!send_frame(fd_, type, text)) throw ClientGone();
+    }
+
+    sol::table make_stream(char type) {
+        sol::table stream = lua_.create_table();
+        stream.set_function("write", [this, type](sol::table self, sol::variadic_args values) {
+            output(type, values, "", "");
+            return self;
+        });
+        return stream;
+    }
+
+    sol::environment make_environment(const Job& job) {
+        sol::environment env(lua_, sol::create, lua_.globals());
+        env.set_function("print", [this](sol::variadic_args values) { output('O', values, "\t", "\n"); });
+
+        sol::table stdoutStream = make_stream('O');
+        sol::table io = lua_.create_table();
+        io.set_function("write", [this, stdoutStream](sol::variadic_args values) {
+            output('O', values, "", "");
+            return stdoutStream;
+        });
+        io["stdout"] = stdoutStream;
+        io["stderr"] = make_stream('E');
+        io[sol::metatable_key] = lua_.create_table_with(sol::meta_function::index, lua_["io"]);
+        env["io"] = io;
+
+        sol::table os = lua_.create_table();
+        os.set_function("exit", [this](sol::object code) {
+            if (code.is<bool>()) exitStatus_ = code.as<bool>() ? 0 : 1;
+            else exitStatus_ = code.is<int>() ? code.as<int>() & 0xff : 0;
+            throw ExitRequested();
+        });
+        os[sol::metatable_key] = lua_.create_table_with(sol::meta_function::index, lua_["os"]);
+        env["os"] = os;
+
+        sol::table arg = lua_.create_table();
+        arg[0] = job.chunkname.empty() ? job.chunkname : job.chunkname.substr(1); // without '@' or '='
+        for (size_t i = 0; i < job.args.size(); ++i) arg[i + 1] = job.args[i];
+        env["arg"] = arg;
+        return env;
+    }
+
+    // Reports errors like the standalone interpreter; returns false when the job must stop.
+    bool run_chunk(const sol::environment& env, sol::load_result chunk, const std::vector<std::string>& args) {
+        if (!chunk.valid()) {
+            sol::error err = chunk;
+            send_frame(fd_, 'E', std::string("luaCurling: ") + err.what() + "\n");
+            return false;
+        }
+        sol::protected_function fn = chunk;
+        env.set_on(fn);
+        curling::trace::Span span("script", "lua");
+        sol::protected_function_result res = fn(sol::as_args(args));
+        if (!res.valid() && exitStatus_ < 0) {
+            sol::error err = res;
+            send_frame(fd_, 'E', std::string("luaCurling: ") + err.what() + "\n");
+        }
+        return res.valid();
+    }
+
+    // Finishes the async requests the job left running, while the client still listens.
+    bool run_pending() {
+        try {
+            curling::runPending();
+            return true;
+        } catch (const std::exception& e) {
+            if (exitStatus_ < 0) send_frame(fd_, 'E', std::string("luaCurling: ") + e.what() + "\n");
+            return false;
+        }
+    }
+
+    // Returns the exit status of the job.
+    int run(const Job& job) {
+        sol::environment env = make_environment(job);
+        bool ok = true;
+        for (size_t i = 0; ok && i < job.chunks.size(); ++i) {
+            ok = run_chunk(env, lua_.load(job.chunks[i], "=(command line)"), {});
+        }
+        if (ok && !job.chunkname.empty()) {
+            std::string source = job.script;
+            if (source.compare(0, 1, "#") == 0) source.replace(0, source.find('\n'), ""); // shebang line
+            ok = run_chunk(env, lua_.load(source, job.chunkname), job.args);
+        }
+        if (ok) ok = run_pending();
+        curling::cancelPending(); // after an error, or if the client is gone
+        if (profiler::sampler().profiling_this_thread()) profiler::sampler().stop(); // a job that forgot to stop it
+        if (exitStatus_ >= 0) return exitStatus_;
+        return ok ? 0 : 1;
+    }
+};
+
+inline std::string listeningPath;
+
+inline void stop(int) {
+    ::unlink(listeningPath.c_str());
+    ::_exit(0);
+}
+
+// === Daemon: accepts jobs on a Unix socket and hands them to a pool of workers ===
+// Each worker thread owns a Worker and installs its own ConnectionCache, because libcurl
+// does not share connections between concurrent threads. The socket is private to the user:
+// anyone who can connect can run code.
+inline int serve(const std::string& path, unsigned workers, bool pooledAllocator, const Worker::Setup& setup) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        std::cerr << "luaCurling: socket path too long: " << path << '\n';
+        return 1;
+    }
+    std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+
+    int listener = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listener < 0) {
+        std::cerr << "luaCurling: socket: " << std::strerror(errno) << '\n';
+        return 1;
+    }
+    if (::connect(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0) {
+        std::cerr << "luaCurling: a daemon is already listening on " << path << '\n';
+        ::close(listener);
+        return 1;
+    }
+    ::close(listener);
+    ::unlink(path.c_str()); // left behind by a daemon that did not stop cleanly
+
+    listener = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    mode_t mask = ::umask(077);
+    bool bound = ::bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+    ::umask(mask);
+    if (!bound || ::listen(listener, SOMAXCONN) != 0) {
+        std::cerr << "luaCurling: cannot listen on " << path << ": " << std::strerror(errno) << '\n';
+        ::close(listener);
+        return 1;
+    }
+    listeningPath = path;
+    std::signal(SIGPIPE, SIG_IGN);
+    std::signal(SIGINT, stop);
+    std::signal(SIGTERM, stop);
+
+    struct Queue {
+        std::mutex mutex;
+        std::condition_variable ready;
+        std::deque<int> pending;
+    };
+    auto queue = std::make_shared<Queue>(); // shared with the detached workers
+    for (unsigned i = 0; i < workers; ++i) {
+        std::thread([queue, pooledAllocator, setup] {
+            curling::setConnectionCache(std::make_shared<curling::ConnectionCache>());
+            Worker worker(pooledAllocator, setup);
+            for (;;) {
+                int fd;
+                {
+                    std::unique_lock<std::mutex> lock(queue->mutex);
+                    queue->ready.wait(lock, [&] { return !queue->pending.empty(); });
+                    fd = queue->pending.front();
+                    queue->pending.pop_front();
+                }
+                worker.serve(fd);
+                ::close(fd);
+            }
+        }).detach();
+    }
+
+    std::cerr << "luaCurling: daemon listening on " << path << " with " << workers << " workers\n";
+    for (;;) {
+        int fd = ::accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            std::cerr << "luaCurling: accept: " << std::strerror(errno) << '\n';
+            ::unlink(path.c_str());
+            return 1;
+        }
+        if (!same_user(fd)) {
+            std::cerr << "luaCurling: refused a connection from another user\n";
+            ::close(fd);
+            continue;
+        }
+        {
+            std::lock_guard<std::mutex> lock(queue->mutex);
+            queue->pending.push_back(fd);
+        }
+        queue->ready.notify_one();
+    }
+}
+
+} // namespace daemon_mode
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace lua_allocator {
+
+// === Memory statistics of one Lua state ===
+struct Stats {
+    size_t live = 0;            // bytes currently allocated by Lua
+    size_t peak = 0;            // highest value of live
+    uint64_t allocations = 0;   // new blocks
+    uint64_t reallocations = 0; // resized blocks
+    uint64_t frees = 0;         // released blocks
+    uint64_t allocated = 0;     // bytes ever requested: new blocks and growth of resized ones
+    size_t reserved = 0;        // bytes held by the pool, used or not
+};
+
+// === lua_Alloc with statistics and an optional size-class pool ===
+// Lua mostly allocates small blocks (tables, strings, closures, upvalues), so blocks up to
+// maxPooled bytes come from per-size free lists carved out of large chunks instead of
+// malloc. Bigger blocks go to realloc. Memory is counted either way.
+// A Lua state is single threaded, so the allocator needs no locking.
+class Allocator {
+public:
+    explicit Allocator(bool pooled = false) : pooled_(pooled) {}
+    ~Allocator() {
+        for (void* chunk : chunks_) std::free(chunk);
+    }
+
+    Allocator(const Allocator&) = delete;
+    Allocator& operator=(const Allocator&) = delete;
+
+    // Pass as lua_newstate(Allocator::allocate, &allocator); the allocator must outlive the state.
+    static void* allocate(void* ud, void* ptr, size_t osize, size_t nsize) noexcept {
+        return static_cast<Allocator*>(ud)->resize(ptr, ptr ? osize : 0, nsize);
+    }
+
+    const Stats& stats() const { return stats_; }
+    bool pooled() const { return pooled_; }
+
+private:
+    static constexpr size_t granule = 16;       // also the block alignment
+    static constexpr size_t maxPooled = 256;
+    static constexpr size_t classes = maxPooled / granule;
+    static constexpr size_t chunkSize = 64 * 1024;
+
+    struct FreeBlock { FreeBlock* next; };
+
+    bool pooled_;
+    Stats stats_;
+    FreeBlock* free_[classes] = {};
+    std::vector<void*> chunks_;
+    char* bump_ = nullptr;
+    size_t bumpLeft_ = 0;
+
+    static size_t classOf(size_t size) { return (size + granule - 1) / granule - 1; }
+    bool isPooled(size_t size) const { return pooled_ && size > 0 && size <= maxPooled; }
+
+    void* resize(void* ptr, size_t osize, size_t nsize) noexcept {
+        void* result = nullptr;
+        if (nsize == 0) {
+            release(ptr, osize);
+        } else if (!isPooled(osize) && !isPooled(nsize)) {
+            result = std::realloc(ptr, nsize);
+        } else if (ptr && isPooled(osize) && isPooled(nsize) && classOf(osize) == classOf(nsize)) {
+            result = ptr; // still fits its block
+        } else {
+            result = isPooled(nsize) ? take(classOf(nsize)) : std::malloc(nsize);
+            if (result && ptr) {
+                std::memcpy(result, ptr, osize < nsize ? osize : nsize);
+                release(ptr, osize);
+            }
+        }
+        if (nsize > 0 && !result) return nullptr; // Lua raises a memory error; ptr is untouched
+
+        if (!ptr) ++stats_.allocations;
+        else if (nsize == 0) ++stats_.frees;
+        else ++stats_.reallocations;
+        if (nsize > osize) stats_.allocated += nsize - osize;
+        stats_.live = stats_.live - osize + nsize;
+        if (stats_.live > stats_.peak) stats_.peak = stats_.live;
+        return result;
+    }
+
+    void release(void* ptr, size_t size) noexcept {
+        if (!ptr) return;
+        if (!isPooled(size)) {
+            std::free(ptr);
+            return;
+        }
+        auto block = static_cast<FreeBlock*>(ptr);
+        size_t cls = classOf(size);
+        block->next = free_[cls];
+        free_[cls] = block;
+    }
+
+    void* take(size_t cls) noexcept {
+        if (FreeBlock* block = free_[cls]) {
+            free_[cls] = block->next;
+            return block;
+        }
+        const size_t blockSize = (cls + 1) * granule;
+        if (bumpLeft_ < blockSize) {
+            // the tail of the old chunk (a multiple of granule) becomes a block of a smaller class
+            if (bumpLeft_ > 0) release(bump_, bumpLeft_);
+            void* chunk = std::malloc(chunkSize);
+            if (!chunk) return nullptr;
+            try {
+                chunks_.push_back(chunk);
+            } catch (...) {
+                std::free(chunk);
+                return nullptr;
+            }
+            stats_.reserved += chunkSize;
+            bump_ = static_cast<char*>(chunk);
+            bumpLeft_ = chunkSize;
+        }
+        void* block = bump_;
+        bump_ += blockSize;
+        bumpLeft_ -= blockSize;
+        return block;
+    }
+};
+
+} // namespace lua_allocator
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <lua.hpp>
+
+namespace lua_bundle {
+
+// === A Lua module compiled into the executable ===
+struct EmbeddedModule {
+    const char* name;           // require name
+    const unsigned char* data;  // bytecode (or source when built without luac)
+    size_t size;
+};
+
+// lua_bundle.inc is generated by `make` from the BUNDLE list; it ends with a null entry.
+#if __has_include("lua_bundle.inc")
+#include "lua_bundle.inc"
+#else
+static const EmbeddedModule embeddedModules[] = {{nullptr, nullptr, 0}};
+#endif
+
+// === package.searchers entry serving embedded modules from memory ===
+inline int searcher(lua_State* L) {
+    const char* name = luaL_checkstring(L, 1);
+    for (const EmbeddedModule* module = embeddedModules; module->name; ++module) {
+        if (std::strcmp(module->name, name) != 0) continue;
+        std::string chunkname = std::string("=[embedded] ") + name;
+        if (luaL_loadbufferx(L, reinterpret_cast<const char*>(module->data), module->size,
+                             chunkname.c_str(), nullptr) != LUA_OK) {
+            return luaL_error(L, "error loading embedded module '%s':\n\t%s", name, lua_tostring(L, -1));
+        }
+        lua_pushliteral(L, ":embedded:"); // second argument of the loader, like the file name for files
+        return 2;
+    }
+    lua_pushfstring(L, "no embedded module '%s'", name);
+    return 1;
+}
+
+// Inserts the searcher right after package.preload, so embedded modules win over package.path.
+inline void install(lua_State* L) {
+    lua_getglobal(L, "package");
+    lua_getfield(L, -1, "searchers");
+    for (int i = static_cast<int>(lua_rawlen(L, -1)); i >= 2; --i) {
+        lua_rawgeti(L, -1, i);
+        lua_rawseti(L, -2, i + 1);
+    }
+    lua_pushcfunction(L, searcher);
+    lua_rawseti(L, -2, 2);
+    lua_pop(L, 2);
+}
+
+} // namespace lua_bundle
@@ -1,75 +1,221 @@
 #include <sol/sol.hpp>
 #include "curling.hpp"
+#include "curling_lua.hpp"
 #include "repl.hpp"
+#include "lua_allocator.hpp"
+#include "lua_bundle.hpp"
+#include "bytecode_cache.hpp"
+#include "daemon.hpp"
+#include "bench.hpp"
+#include "profiler.hpp"
 
-void register_curling(sol::state& lua) {
-    using namespace curling;
-
-    lua.new_enum<Request::Method>("HttpMethod", {
-        {"GET", Request::Method::GET},
-        {"POST", Request::Method::POST},
-        {"PUT", Request::Method::PUT},
-        {"DELETE", Request::Method::DEL},
-        {"PATCH", Request::Method::PATCH},
-        {"HEAD", Request::Method::HEAD},
-        {"MIME", Request::Method::MIME}
-    });
+// Taken during static initialization, as close to process start as portable code gets.
+static const std::int64_t processStartNs = curling::detail::steadyNowNs();
 
-    lua.new_enum<Request::HttpVersion>("HttpVersion", {
-        {"DEFAULT", Request::HttpVersion::DEFAULT},
-        {"HTTP_1_1", Request::HttpVersion::HTTP_1_1},
-        {"HTTP_2", Request::HttpVersion::HTTP_2},
-        {"HTTP_3", Request::HttpVersion::HTTP_3}
-    });
+void print_usage(std::ostream& out, const char* program) {
+    out << "usage: " << program << " [options] [script [args]]\n"
+        << "  -e chunk  run the Lua chunk (may be repeated)\n"
+        << "  -i        enter the REPL after running the script or chunks\n"
+        << "  -         run stdin as a script\n"
+        << "  --        stop handling options\n"
+        << "  -h        show this help\n"
+        << "  --daemon  serve scripts sent with --remote over a Unix socket\n"
+        << "  --remote  run the script or chunks on the daemon instead of in this process\n"
+        << "  --profile file  sample Lua stacks every millisecond and write them to file as folded stacks\n"
+        << "Without a script, runs stdin when it is not a terminal and starts the REPL otherwise.\n"
+        << "LUACURLING_TIMING=1 prints startup timings to stderr on exit.\n"
+        << "LUACURLING_CACHE=dir caches compiled scripts in dir.\n"
+        << "LUACURLING_SOCKET=path sets the daemon socket (default " << daemon_mode::socket_path() << "),\n"
+        << "LUACURLING_WORKERS=n the number of scripts the daemon runs at once (default 4).\n";
+}
+
+// Builds the global arg table like the standalone lua interpreter: arg[0] is the script,
+// positive indices its arguments, negative ones the interpreter and its options.
+void set_arg_table(sol::state& lua, int argc, char* argv[], int scriptIndex) {
+    sol::table arg = lua.create_table();
+    const int base = scriptIndex < 0 ? argc : scriptIndex;
+    for (int i = 0; i < argc; ++i) arg[i - base] = argv[i];
+    if (scriptIndex < 0) arg[0] = argv[0];
+    lua["arg"] = arg;
+}
+
+// Runs a loaded chunk with the script arguments as varargs; reports errors like lua does.
+bool run_chunk(sol::load_result chunk, const std::vector<std::string>& args) {
+    if (!chunk.valid()) {
+        sol::error err = chunk;
+        std::cerr << "luaCurling: " << err.what() << '\n';
+        return false;
+    }
+    sol::protected_function fn = chunk;
+    curling::trace::Span span("script", "lua");
+    sol::protected_function_result res = fn(sol::as_args(args));
+    if (!res.valid()) {
+        sol::error err = res;
+        std::cerr << "luaCurling: " << err.what() << '\n';
+        return false;
+    }
+    return true;
+}
 
-    lua.new_usertype<Response>("Response",
-        "httpCode", &Response::httpCode,
-        "body", &Response::body,
-        "headers", &Response::headers,
-        "toString", &Response::toString,
-        "getHeader", &Response::getHeader
-    );
-
-    lua.new_usertype<Request>("Request",
-        sol::constructors<Request()>(),
-
-        "setMethod", &Request::setMethod,
-        "setURL", &Request::setURL,
-        "addHeader", &Request::addHeader,
-        "setBody", &Request::setBody,
-        "send", &Request::send,
-        "reset", &Request::reset,
-        "setTimeout", &Request::setTimeout,
-        "setConnectTimeout", &Request::setConnectTimeout,
-        "setFollowRedirects", &Request::setFollowRedirects,
-        "setUserAgent", &Request::setUserAgent,
-        "setHttpVersion", &Request::setHttpVersion,
-        "addArg", &Request::addArg,
-        "setAuthToken", &Request::setAuthToken,
-        "downloadToFile", &Request::downloadToFile,
-        "setCookiePath", &Request::setCookiePath,
-        "addFormField", &Request::addFormField,
-        "addFormFile", &Request::addFormFile,
-        "enableVerbose", &Request::enableVerbose,
-        "setProxy", &Request::setProxy,
-        "setProxyAuth", &Request::setProxyAuth,
-        "setProxyAuthMethod", &Request::setProxyAuthMethod,
-        "setHttpAuth", &Request::setHttpAuth,
-        "setHttpAuthMethod", &Request::setHttpAuthMethod,
-        "setHttpVersion", &Request::setHttpVersion
-    );
-
-    lua["curling_version"] = &curling::version;
-    lua["waitMS"] = &curling::waitMs;
+sol::load_result load_stdin(sol::state& lua) {
+    std::string code((std::istreambuf_iterator<char>(std::cin)), std::istreambuf_iterator<char>());
+    if (code.compare(0, 1, "#") == 0) code.replace(0, code.find('\n'), ""); // shebang line; keep line numbers
+    return lua.load(code, "=stdin");
 }
 
-int main() {
-    sol::state lua;
-    lua.open_libraries(sol::lib::base, sol::lib::package, sol::lib::table, sol::lib::string, sol::lib::math);
+// LUACURLING_CACHE=dir keeps compiled scripts in dir, keyed by a hash of their source.
+sol::load_result load_script(sol::state& lua, const std::string& path) {
+    const char* cacheDir = std::getenv("LUACURLING_CACHE");
+    if (!cacheDir || !*cacheDir) return lua.load_file(path);
+    lua_State* L = lua;
+    auto status = static_cast<sol::load_status>(bytecode_cache::load_file(L, path, cacheDir));
+    return sol::load_result(L, lua_absindex(L, -1), 1, 1, status);
+}
 
+// Libraries and bindings of every Lua state, in this process or in the daemon.
+void open_state(sol::state& lua) {
+    lua.open_libraries(sol::lib::base, sol::lib::package, sol::lib::coroutine, sol::lib::table, sol::lib::io,
+                       sol::lib::os, sol::lib::string, sol::lib::math, sol::lib::utf8);
+    lua_bundle::install(lua);
     register_curling(lua);
+}
+
+// Reads the -e chunks, script and arguments to send with --remote; false if the script cannot be read.
+bool make_job(daemon_mode::Job& job, std::vector<std::string> chunks, int argc, char* argv[], int scriptIndex,
+              bool readStdin) {
+    job.chunks = std::move(chunks);
+    if (scriptIndex >= 0) job.args.assign(argv + scriptIndex + 1, argv + argc);
+    if (readStdin) {
+        job.chunkname = "=stdin";
+        job.script.assign(std::istreambuf_iterator<char>(std::cin), std::istreambuf_iterator<char>());
+        return true;
+    }
+    if (scriptIndex < 0) return true;
+    job.chunkname = std::string("@") + argv[scriptIndex];
+    if (!bytecode_cache::read_file(argv[scriptIndex], job.script)) {
+        std::cerr << "luaCurling: cannot open " << argv[scriptIndex] << ": " << std::strerror(errno) << '\n';
+        return false;
+    }
+    return true;
+}
+
+// Like a script's own curling.run(): finishes the async requests it left running.
+bool run_pending() {
+    try {
+        curling::runPending();
+        return true;
+    } catch (const std::exception& e) {
+        std::cerr << "luaCurling: " << e.what() << '\n';
+        return false;
+    }
+}
+
+void print_timings(std::int64_t readyNs) {
+    auto ms = [](std::int64_t ns) { return static_cast<double>(ns - processStartNs) / 1e6; };
+    std::fprintf(stderr, "startup: ready %.2f ms", ms(readyNs));
+    if (std::int64_t first = curling::firstSendTime()) std::fprintf(stderr, ", first request %.2f ms", ms(first));
+    std::fprintf(stderr, ", exit %.2f ms\n", ms(curling::detail::steadyNowNs()));
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<std::string> chunks;
+    int scriptIndex = -1;
+    bool interactive = false;
+    bool readStdin = false;
+    bool daemon = false;
+    bool remote = false;
+    std::string profilePath;
+    for (int i = 1; i < argc; ++i) {
+        const std::string option = argv[i];
+        if (option == "-e" && i + 1 < argc) {
+            chunks.push_back(argv[++i]);
+        } else if (option == "-i") {
+            interactive = true;
+        } else if (option == "--daemon") {
+            daemon = true;
+        } else if (option == "--remote") {
+            remote = true;
+        } else if (option == "--profile" && i + 1 < argc) {
+            profilePath = argv[++i];
+        } else if (option == "-h" || option == "--help") {
+            print_usage(std::cout, argv[0]);
+            return 0;
+        } else if (option == "-") {
+            readStdin = true;
+            scriptIndex = i;
+            break;
+        } else if (option == "--") {
+            if (i + 1 < argc) scriptIndex = i + 1;
+            break;
+        } else if (option[0] == '-') {
+            std::cerr << "luaCurling: unrecognized option '" << option << "'\n";
+            print_usage(std::cerr, argv[0]);
+            return 1;
+        } else {
+            scriptIndex = i;
+            break;
+        }
+    }
+    // a pipe on stdin with nothing else to run is a script
+    if (scriptIndex < 0 && chunks.empty() && !interactive && !isatty(STDIN_FILENO)) readStdin = true;
+
+    // LUACURLING_ALLOCATOR=pool serves small Lua allocations from size-class pools
+    const char* allocatorMode = std::getenv("LUACURLING_ALLOCATOR");
+    const bool pooled = allocatorMode && std::string(allocatorMode) == "pool";
+
+    if ((daemon || remote) && !profilePath.empty()) {
+        std::cerr << "luaCurling: --profile cannot be combined with --daemon or --remote\n";
+        return 1;
+    }
+    if (daemon) {
+        const char* workers = std::getenv("LUACURLING_WORKERS");
+        const int count = workers ? std::atoi(workers) : 0;
+        return daemon_mode::serve(daemon_mode::socket_path(), count > 0 ? count : 4, pooled, open_state);
+    }
+    if (remote) {
+        if (interactive || (scriptIndex < 0 && !readStdin && chunks.empty())) {
+            std::cerr << "luaCurling: --remote needs a script or -e chunks, and cannot start the REPL\n";
+            return 1;
+        }
+        const std::int64_t readyNs = curling::detail::steadyNowNs();
+        daemon_mode::Job job;
+        if (!make_job(job, std::move(chunks), argc, argv, scriptIndex, readStdin)) return 1;
+        int status = daemon_mode::run_remote(daemon_mode::socket_path(), job);
+        const char* timing = std::getenv("LUACURLING_TIMING");
+        if (timing && std::string(timing) == "1") print_timings(readyNs);
+        return status;
+    }
+
+    lua_allocator::Allocator allocator(pooled);
+    sol::state lua(sol::default_at_panic, &lua_allocator::Allocator::allocate, &allocator);
+    open_state(lua);
+    if (!profilePath.empty()) {
+        profiler::sampler().flush_on_exit(profilePath);
+        profiler::sampler().start(lua, std::chrono::milliseconds(1));
+    }
+
+    const bool scripted = scriptIndex >= 0 || readStdin || !chunks.empty();
+    if (scripted) {
+        set_arg_table(lua, argc, argv, scriptIndex);
+        std::vector<std::string> args;
+        if (scriptIndex >= 0) args.assign(argv + scriptIndex + 1, argv + argc);
+
+        const char* timing = std::getenv("LUACURLING_TIMING");
+        const std::int64_t readyNs = curling::detail::steadyNowNs();
+        bool ok = true;
+        for (size_t i = 0; ok && i < chunks.size(); ++i) {
+            ok = run_chunk(lua.load(chunks[i], "=(command line)"), {});
+        }
+        if (ok && readStdin) ok = run_chunk(load_stdin(lua), args);
+        else if (ok && scriptIndex >= 0) ok = run_chunk(load_script(lua, argv[scriptIndex]), args);
+        ok = ok && run_pending();
+        if (timing && std::string(timing) == "1") print_timings(readyNs);
+        if (!ok) return 1;
+        if (!interactive) return 0;
+    }
 
     repl::REPL shell([&lua](const std::string& input) {
+        curling::trace::Span span("eval", "lua");
         sol::protected_function_result res = lua.safe_script(input, sol::script_pass_on_error);
         if (!res.valid()) {
             sol::error err = res;
@@ -77,6 +223,38 @@ int main() {
         }
     });
 
+    // background requests progress while the REPL waits for input; their callbacks run between prompts
+    shell.set_event_loop(
+        [](int fd) {
+            curling::detail::BlockedScope idle(curling::Blocked::Idle); // not sampled by the profiler
+            bool readable = curling::poll(-1, fd);
+            if (curling::ready() > 0) return repl::Wake::Events;
+            return readable ? repl::Wake::Input : repl::Wake::Nothing;
+        },
+        [] {
+            try {
+                curling::dispatch();
+            } catch (const std::exception& e) {
+                std::cerr << "Lua error: " << e.what() << '\n';
+            }
+        });
+
+    shell.add_command("mem", "show Lua memory statistics", [&allocator](const std::string&) {
+        const lua_allocator::Stats& stats = allocator.stats();
+        std::cout << "live " << stats.live << " B, peak " << stats.peak << " B, reserved " << stats.reserved
+                  << " B\nallocations " << stats.allocations << ", reallocations " << stats.reallocations
+                  << ", frees " << stats.frees << (allocator.pooled() ? " (pooled)" : "") << "\n";
+    });
+
+    shell.add_command("time", "run a chunk once: wall time, CPU time and allocations", [&lua, &allocator](const std::string& code) {
+        bench::time_chunk(lua, allocator, code);
+    });
+
+    shell.add_command("bench", "N [-c C] <lua>: run a chunk N times, C at a time, and show latency percentiles",
+                      [&lua, &allocator](const std::string& args) {
+        bench::bench_chunk(lua, allocator, args);
+    });
+
     shell.run();
 
     return 0;
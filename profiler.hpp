@@ -0,0 +1,323 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <pthread.h>
+#include <lua.hpp>
+#include "curling.hpp"
+
+namespace profiler {
+
+// === Sampling profiler for Lua ===
+// A sampler thread sends SIGPROF to the profiled thread at a fixed interval of wall time,
+// so time spent waiting is sampled as well as time spent computing. The signal handler
+// counts the tick by what the thread is doing:
+//   - blocked in curling (curling::detail::blockedOn): a transfer, a retry backoff, a rate
+//     limiter or poll(); charged to a "[curling] ..." frame under the Lua caller;
+//   - running native code, when the Lua hook has not run since the previous tick, i.e.
+//     fewer than hookInstructions Lua instructions ran in a whole interval: C functions,
+//     the bindings, the collector; charged to a "[native]" frame under the Lua caller;
+//   - running Lua otherwise.
+// Ticks while the thread is marked Idle (a REPL waiting for input) are dropped.
+// A signal handler cannot walk the Lua stack, so it only arms the hook of the running Lua
+// thread to fire at the next instruction (lua_sethook is safe in a signal handler, the
+// standalone interpreter handles Ctrl+C that way). The hook charges the counted ticks to
+// the current stack. Between samples, the hook runs every hookInstructions instructions.
+// The result is folded stacks, one "frame;frame;frame count" line per stack, as read by
+// flamegraph.pl and speedscope.
+// One thread of one Lua state is profiled at a time. Coroutines created while the profiler
+// runs inherit its hook, older ones are not sampled, and debug.sethook replaces it.
+
+constexpr int hookInstructions = 1000;
+constexpr int blockedKinds = static_cast<int>(curling::Blocked::Idle) + 1;
+
+namespace detail {
+
+// Shared with the signal handler; lock-free atomics are async-signal-safe.
+inline std::atomic<bool> active{false};
+inline std::atomic<int> luaTicks{0};
+inline std::atomic<int> nativeTicks{0};
+inline std::atomic<int> blockedTicks[blockedKinds];
+inline std::atomic<unsigned> hookRuns{0};
+inline unsigned hookRunsAtTick = 0; // handler only
+inline std::atomic<const volatile std::sig_atomic_t*> blockedOn{nullptr}; // the profiled thread's
+inline std::atomic<lua_State*> mainState{nullptr};
+// The Lua thread the hook last ran in. The registry keeps it alive under runningKey, and it
+// is replaced there only after this pointer has moved on, so the handler never sees it freed.
+inline std::atomic<lua_State*> runningState{nullptr};
+inline pthread_t target;
+
+constexpr const char* runningKey = "curling.profiler.running";
+constexpr const char* sentinelKey = "curling.profiler.sentinel";
+
+static_assert(ATOMIC_INT_LOCK_FREE == 2 && ATOMIC_POINTER_LOCK_FREE == 2 && ATOMIC_BOOL_LOCK_FREE == 2,
+              "the signal handler needs lock-free atomics");
+
+inline void on_hook(lua_State* L, lua_Debug*);
+
+inline void on_tick(int) {
+    if (!active.load(std::memory_order_relaxed)) return;
+    const int saved = errno;
+    const volatile std::sig_atomic_t* blockedFlag = blockedOn.load(std::memory_order_relaxed);
+    const int blocked = blockedFlag ? static_cast<int>(*blockedFlag) : 0;
+    const unsigned runs = hookRuns.load(std::memory_order_relaxed);
+    const bool idle = blocked == static_cast<int>(curling::Blocked::Idle);
+    if (blocked > 0 && blocked < blockedKinds) {
+        if (!idle) blockedTicks[blocked].fetch_add(1, std::memory_order_relaxed);
+    } else if (runs == hookRunsAtTick) {
+        nativeTicks.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        luaTicks.fetch_add(1, std::memory_order_relaxed);
+    }
+    hookRunsAtTick = runs;
+    if (!idle) {
+        lua_State* main = mainState.load(std::memory_order_relaxed);
+        lua_State* running = runningState.load(std::memory_order_relaxed);
+        if (main) lua_sethook(main, on_hook, LUA_MASKCOUNT, 1);
+        if (running && running != main) lua_sethook(running, on_hook, LUA_MASKCOUNT, 1);
+    }
+    errno = saved;
+}
+
+inline const char* blocked_frame(int blocked) {
+    switch (static_cast<curling::Blocked>(blocked)) {
+        case curling::Blocked::Transfer: return "[curling] transfer";
+        case curling::Blocked::Backoff: return "[curling] backoff";
+        case curling::Blocked::RateLimit: return "[curling] rate limit";
+        case curling::Blocked::Poll: return "[curling] poll";
+        default: return "[curling]";
+    }
+}
+
+// "name file:line" for Lua functions, "name [C]" for C functions, "main file" for chunks.
+inline std::string frame_name(lua_State* L, lua_Debug& ar) {
+    lua_getinfo(L, "Sn", &ar);
+    std::string name;
+    if (ar.what[0] == 'C') {
+        name = std::string(ar.name ? ar.name : "?") + " [C]";
+    } else if (ar.what[0] == 'm') {
+        name = std::string("main ") + ar.short_src;
+    } else {
+        if (ar.name) name = std::string(ar.name) + " ";
+        name += std::string(ar.short_src) + ":" + std::to_string(ar.linedefined);
+    }
+    std::replace(name.begin(), name.end(), ';', ','); // the frame separator
+    std::replace(name.begin(), name.end(), '\n', ' ');
+    return name;
+}
+
+inline std::string stack_of(lua_State* L) {
+    std::vector<std::string> frames;
+    lua_Debug ar;
+    for (int level = 0; lua_getstack(L, level, &ar); ++level) frames.push_back(frame_name(L, ar));
+    std::string stack;
+    for (auto it = frames.rbegin(); it != frames.rend(); ++it) {
+        if (!stack.empty()) stack += ';';
+        stack += *it;
+    }
+    return stack.empty() ? "?" : stack;
+}
+
+inline lua_State* main_thread(lua_State* L) {
+    lua_rawgeti(L, LUA_REGISTRYINDEX, LUA_RIDX_MAINTHREAD);
+    lua_State* main = lua_tothread(L, -1);
+    lua_pop(L, 1);
+    return main;
+}
+
+} // namespace detail
+
+class Sampler {
+public:
+    Sampler() = default;
+    ~Sampler() {
+        stop();
+        if (exitPath_.empty()) return;
+        try {
+            flush(exitPath_);
+        } catch (const std::exception& e) {
+            std::fprintf(stderr, "%s\n", e.what());
+        }
+    }
+
+    Sampler(const Sampler&) = delete;
+    Sampler& operator=(const Sampler&) = delete;
+
+    // Starts sampling the calling thread, which runs L, every interval; false if already running.
+    bool start(lua_State* L, std::chrono::microseconds interval) {
+        if (thread_.joinable()) return false;
+        static const bool installed = [] {
+            struct sigaction sa {};
+            sa.sa_handler = detail::on_tick;
+            sigemptyset(&sa.sa_mask);
+            sa.sa_flags = SA_RESTART; // blocking reads and writes carry on; poll() just wakes up early
+            return sigaction(SIGPROF, &sa, nullptr) == 0;
+        }();
+        if (!installed) return false;
+
+        lua_State* main = detail::main_thread(L);
+        install_sentinel(main);
+        lua_pushthread(L);
+        lua_setfield(L, LUA_REGISTRYINDEX, detail::runningKey);
+        detail::runningState = L;
+        detail::mainState = main;
+        detail::luaTicks = 0;
+        detail::nativeTicks = 0;
+        for (auto& ticks : detail::blockedTicks) ticks = 0;
+        detail::blockedOn = &curling::detail::blockedOn;
+        detail::target = pthread_self();
+        detail::active = true;
+        lua_sethook(main, detail::on_hook, LUA_MASKCOUNT, hookInstructions); // inherited by new coroutines
+        if (L != main) lua_sethook(L, detail::on_hook, LUA_MASKCOUNT, hookInstructions);
+
+        stopping_ = false;
+        const pthread_t target = detail::target;
+        interval = std::max(interval, std::chrono::microseconds(100));
+        thread_ = std::thread([this, interval, target] {
+            std::unique_lock<std::mutex> lock(stopMutex_);
+            while (!wake_.wait_for(lock, interval, [this] { return stopping_; })) pthread_kill(target, SIGPROF);
+        });
+        return true;
+    }
+
+    // Stops sampling. The hooks remove themselves the next time they run.
+    void stop() {
+        if (!thread_.joinable()) return;
+        detail::active = false;
+        {
+            std::lock_guard<std::mutex> lock(stopMutex_);
+            stopping_ = true;
+        }
+        wake_.notify_one();
+        thread_.join();
+        detail::mainState = nullptr;
+        detail::runningState = nullptr;
+        detail::blockedOn = nullptr;
+    }
+
+    bool running() const { return thread_.joinable(); }
+
+    bool profiling_this_thread() const { return running() && pthread_equal(detail::target, pthread_self()); }
+
+    void record(const std::string& stack, std::uint64_t count) {
+        std::lock_guard<std::mutex> lock(samplesMutex_);
+        samples_[stack] += count;
+    }
+
+    // The samples as folded stacks.
+    std::string folded() const {
+        std::lock_guard<std::mutex> lock(samplesMutex_);
+        std::string out;
+        for (const auto& sample : samples_) {
+            out += sample.first;
+            out += ' ';
+            out += std::to_string(sample.second);
+            out += '\n';
+        }
+        return out;
+    }
+
+    void flush(const std::string& path) const {
+        const std::string text = folded();
+        curling::FilePtr file(std::fopen(path.c_str(), "wb"));
+        if (!file || std::fwrite(text.data(), 1, text.size(), file.get()) != text.size()) {
+            throw curling::CurlingException("Failed to write profile: " + path);
+        }
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(samplesMutex_);
+        samples_.clear();
+    }
+
+    // Writes the samples to path when the process exits, os.exit() included.
+    void flush_on_exit(const std::string& path) { exitPath_ = path; }
+
+private:
+    std::thread thread_;
+    std::mutex stopMutex_;
+    std::condition_variable wake_;
+    bool stopping_ = false;
+    mutable std::mutex samplesMutex_;
+    std::map<std::string, std::uint64_t> samples_;
+    std::string exitPath_;
+
+    // The signal handler must not touch a closed state: a registry object whose finalizer
+    // stops the sampler when the state being profiled is closed.
+    static void install_sentinel(lua_State* main) {
+        if (lua_getfield(main, LUA_REGISTRYINDEX, detail::sentinelKey) != LUA_TNIL) {
+            lua_pop(main, 1);
+            return;
+        }
+        lua_pop(main, 1);
+        lua_newuserdatauv(main, 0, 0);
+        lua_createtable(main, 0, 1);
+        lua_pushcfunction(main, on_close);
+        lua_setfield(main, -2, "__gc");
+        lua_setmetatable(main, -2);
+        lua_setfield(main, LUA_REGISTRYINDEX, detail::sentinelKey);
+    }
+
+    static int on_close(lua_State* L);
+};
+
+// The process has one sampler: SIGPROF has one handler.
+inline Sampler& sampler() {
+    static Sampler instance;
+    return instance;
+}
+
+inline int Sampler::on_close(lua_State* L) {
+    if (detail::mainState.load() == detail::main_thread(L)) sampler().stop();
+    return 0;
+}
+
+namespace detail {
+
+inline void on_hook(lua_State* L, lua_Debug*) {
+    hookRuns.fetch_add(1, std::memory_order_relaxed);
+    if (!active.load(std::memory_order_relaxed)) {
+        lua_sethook(L, nullptr, 0, 0);
+        return;
+    }
+    if (!pthread_equal(target, pthread_self())) return; // a coroutine resumed on another thread
+    if (lua_gethookcount(L) != hookInstructions) lua_sethook(L, on_hook, LUA_MASKCOUNT, hookInstructions); // was armed
+    if (runningState.load(std::memory_order_relaxed) != L) {
+        runningState.store(L, std::memory_order_relaxed);
+        lua_pushthread(L);
+        lua_setfield(L, LUA_REGISTRYINDEX, runningKey);
+    }
+
+    const int lua = luaTicks.exchange(0, std::memory_order_relaxed);
+    const int native = nativeTicks.exchange(0, std::memory_order_relaxed);
+    int blocked[blockedKinds] = {};
+    int total = lua + native;
+    for (int kind = 1; kind < blockedKinds; ++kind) {
+        blocked[kind] = blockedTicks[kind].exchange(0, std::memory_order_relaxed);
+        total += blocked[kind];
+    }
+    if (total == 0) return;
+
+    const std::string stack = stack_of(L);
+    Sampler& profile = sampler();
+    if (lua > 0) profile.record(stack, static_cast<std::uint64_t>(lua));
+    if (native > 0) profile.record(stack + ";[native]", static_cast<std::uint64_t>(native));
+    for (int kind = 1; kind < blockedKinds; ++kind) {
+        if (blocked[kind] > 0) profile.record(stack + ';' + blocked_frame(kind), static_cast<std::uint64_t>(blocked[kind]));
+    }
+}
+
+} // namespace detail
+
+} // namespace profiler
@@ -3,6 +3,7 @@
 #include <iostream>
 #include <string>
 #include <vector>
+#include <map>
 #include <functional>
 #include <termios.h>
 #include <unistd.h>
@@ -18,6 +19,7 @@ static struct termios g_orig_termios;
 static volatile sig_atomic_t g_got_sigint = 0;
 
 void restore_terminal() {
+    std::cout << "\x1b[?2004l" << std::flush; // bracketed paste off
     tcsetattr(STDIN_FILENO, TCSAFLUSH, &g_orig_termios);
 }
 
@@ -41,6 +43,7 @@ public:
         raw.c_cc[VMIN] = 1;
         raw.c_cc[VTIME] = 0;
         tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw);
+        std::cout << "\x1b[?2004h" << std::flush; // bracketed paste: pastes arrive between ESC[200~ and ESC[201~
     }
 
     ~TerminalRawMode() {
@@ -48,15 +51,44 @@ public:
     }
 };
 
+// What ended a wait of the event loop.
+enum class Wake {
+    Input,   // the input fd is readable
+    Events,  // something is ready for the deliver callback
+    Nothing  // timeout or signal
+};
+
 // === REPL ===
 class REPL {
 public:
     using EvalCallback = std::function<void(const std::string&)>;
+    using CommandCallback = std::function<void(const std::string& args)>;
+    using WaitCallback = std::function<Wake(int fd)>;
+    using DeliverCallback = std::function<void()>;
 
     REPL(EvalCallback callback,
          const std::string& prompt = ">>> ",
          const std::string& more_prompt = "... ")
-        : callback_(callback), prompt_(prompt), more_prompt_(more_prompt), history_index_(0) {}
+        : callback_(callback), prompt_(prompt), more_prompt_(more_prompt), history_index_(0) {
+        add_command("help", "list meta-commands", [this](const std::string&) {
+            for (const auto& command : commands_) {
+                std::cout << "  :" << command.first << "  " << command.second.help << "\n";
+            }
+        });
+    }
+
+    // Registers a meta-command: a line ":name args" runs callback(args) instead of being evaluated.
+    void add_command(const std::string& name, const std::string& help, CommandCallback callback) {
+        commands_[name] = Command{help, std::move(callback)};
+    }
+
+    // Lets an event loop run while the REPL waits for input: wait blocks until fd is readable
+    // or events are ready, and deliver handles them (e.g. callbacks printing completion
+    // notices) while the line being edited is cleared; the line is redrawn afterwards.
+    void set_event_loop(WaitCallback wait, DeliverCallback deliver) {
+        wait_ = std::move(wait);
+        deliver_ = std::move(deliver);
+    }
 
     void run() {
         // Set up SIGINT handler
@@ -75,31 +107,37 @@ public:
             history_index_ = history_.size();
 
             std::string current_prompt = buffer_lines.empty() ? prompt_ : more_prompt_;
-            std::cout << current_prompt << std::flush;
+            out_ += current_prompt;
             line.clear();
 
             while (true) {
                 if (g_got_sigint) {
                     g_got_sigint = 0;
                     buffer_lines.clear();
-                    std::cout << current_prompt << std::flush;
+                    out_ += current_prompt;
                     break;  // restart prompt after ^C
                 }
 
+                if (!wait_input(current_prompt, line, cursor_pos)) {
+                    continue;  // interrupted
+                }
+
                 char c;
-                ssize_t n = read(STDIN_FILENO, &c, 1);
+                ssize_t n = read_byte(c);
                 if (n == -1 && errno == EINTR) {
                     continue;  // retry on interrupted read
                 } else if (n <= 0) {
-                    std::cout << "\n";
+                    out_ += "\n";
+                    flush_output();
                     return; // Ctrl+D or read error
                 }
 
                 if (c == 4) { // Ctrl+D
-                    std::cout << "\n";
+                    out_ += "\n";
+                    flush_output();
                     return;
-                } else if (c == '\n') {
-                    std::cout << "\n";
+                } else if (c == '\n' || c == '\r') {
+                    out_ += "\n";
                     if (!line.empty() && line.back() == '\\') {
                         line.pop_back();
                         buffer_lines.push_back(line);
@@ -110,7 +148,10 @@ public:
                         if (!full_input.empty()) {
                             history_.push_back(full_input);
                         }
-                        callback_(full_input);
+                        flush_output();
+                        if (!run_command(full_input)) {
+                            callback_(full_input);
+                        }
                         buffer_lines.clear();
                         break;
                     }
@@ -118,74 +159,191 @@ public:
                     if (cursor_pos > 0) {
                         line.erase(cursor_pos - 1, 1);
                         cursor_pos--;
-                        redraw_line(current_prompt, line, cursor_pos);
+                        if (cursor_pos == line.size()) {
+                            out_ += "\b\x1b[K"; // at the end: erase one cell
+                        } else {
+                            redraw_line(current_prompt, line, cursor_pos);
+                        }
                     }
-                } else if (c == '\x1b') { // Arrow keys
-                    char seq[2];
-                    if (read(STDIN_FILENO, &seq[0], 1) != 1) break;
-                    if (read(STDIN_FILENO, &seq[1], 1) != 1) break;
-                    if (seq[0] == '[') {
-                        switch (seq[1]) {
-                            case 'D': // ←
-                                if (cursor_pos > 0) {
-                                    std::cout << "\x1b[1D" << std::flush;
-                                    cursor_pos--;
-                                }
-                                break;
-                            case 'C': // →
-                                if (cursor_pos < line.size()) {
-                                    std::cout << "\x1b[1C" << std::flush;
-                                    cursor_pos++;
-                                }
-                                break;
-                            case 'A': // ↑
-                                if (history_index_ > 0) {
-                                    history_index_--;
-                                    line = history_[history_index_];
-                                    cursor_pos = line.size();
-                                    redraw_line(current_prompt, line, cursor_pos);
-                                }
-                                break;
-                            case 'B': // ↓
-                                if (history_index_ + 1 < history_.size()) {
-                                    history_index_++;
-                                    line = history_[history_index_];
-                                    cursor_pos = line.size();
-                                } else {
-                                    history_index_ = history_.size();
-                                    line.clear();
-                                    cursor_pos = 0;
-                                }
-                                redraw_line(current_prompt, line, cursor_pos);
-                                break;
+                } else if (c == '\x1b') { // Arrow keys, bracketed paste
+                    std::string seq;
+                    if (!read_escape(seq)) break;
+                    if (seq == "[200~") {
+                        paste(buffer_lines, current_prompt, line, cursor_pos);
+                    } else if (seq == "[D") { // ←
+                        if (cursor_pos > 0) {
+                            out_ += "\x1b[1D";
+                            cursor_pos--;
+                        }
+                    } else if (seq == "[C") { // →
+                        if (cursor_pos < line.size()) {
+                            out_ += "\x1b[1C";
+                            cursor_pos++;
                         }
+                    } else if (seq == "[A") { // ↑
+                        if (history_index_ > 0) {
+                            history_index_--;
+                            line = history_[history_index_];
+                            cursor_pos = line.size();
+                            redraw_line(current_prompt, line, cursor_pos);
+                        }
+                    } else if (seq == "[B") { // ↓
+                        if (history_index_ + 1 < history_.size()) {
+                            history_index_++;
+                            line = history_[history_index_];
+                            cursor_pos = line.size();
+                        } else {
+                            history_index_ = history_.size();
+                            line.clear();
+                            cursor_pos = 0;
+                        }
+                        redraw_line(current_prompt, line, cursor_pos);
                     }
                 } else if (isprint(static_cast<unsigned char>(c))) {
                     line.insert(cursor_pos, 1, c);
                     cursor_pos++;
-                    redraw_line(current_prompt, line, cursor_pos);
+                    if (cursor_pos == line.size()) {
+                        out_ += c; // typing at the end: echo the character only
+                    } else {
+                        redraw_line(current_prompt, line, cursor_pos);
+                    }
                 }
             }
         }
     }
 
 private:
+    struct Command {
+        std::string help;
+        CommandCallback callback;
+    };
+
     EvalCallback callback_;
+    std::map<std::string, Command> commands_;
     std::string prompt_;
     std::string more_prompt_;
     std::vector<std::string> history_;
     size_t history_index_;
+    // Input is read in blocks, and the terminal output of all input already read is
+    // written at once before the next blocking read, so pastes cost O(n) output.
+    char input_[4096];
+    size_t input_pos_ = 0;
+    size_t input_len_ = 0;
+    std::string out_;
+    WaitCallback wait_;
+    DeliverCallback deliver_;
+
+    // Runs the event loop until input is available; false when interrupted by a signal.
+    bool wait_input(const std::string& prompt, const std::string& line, size_t cursor_pos) {
+        if (!wait_ || input_pos_ < input_len_) return true;
+        while (true) {
+            flush_output();
+            Wake wake = wait_(STDIN_FILENO);
+            if (wake == Wake::Input) return true;
+            if (g_got_sigint) return false;
+            if (wake == Wake::Events) {
+                out_ += "\r\033[K";
+                flush_output();
+                deliver_();
+                redraw_line(prompt, line, cursor_pos);
+            }
+        }
+    }
+
+    // Same results as read(STDIN_FILENO, &c, 1); flushes the pending output before blocking.
+    ssize_t read_byte(char& c) {
+        if (input_pos_ == input_len_) {
+            flush_output();
+            ssize_t n = read(STDIN_FILENO, input_, sizeof(input_));
+            if (n <= 0) return n;
+            input_pos_ = 0;
+            input_len_ = static_cast<size_t>(n);
+        }
+        c = input_[input_pos_++];
+        return 1;
+    }
+
+    void flush_output() {
+        std::cout.flush(); // keep the order with output written through std::cout or stdio
+        std::fflush(stdout);
+        const char* p = out_.data();
+        size_t left = out_.size();
+        while (left > 0) {
+            ssize_t n = write(STDOUT_FILENO, p, left);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            p += n;
+            left -= static_cast<size_t>(n);
+        }
+        out_.clear();
+    }
+
+    // Reads the rest of an escape sequence: '[', parameters, final byte (e.g. "[A", "[200~").
+    bool read_escape(std::string& seq) {
+        char c;
+        while (read_byte(c) == 1) {
+            seq += c;
+            if (seq.size() == 1) {
+                if (c != '[') return true;
+            } else if (c >= 0x40 && c <= 0x7e) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Inserts bracketed-paste text (up to ESC [201~) verbatim at the cursor. Each pasted
+    // newline completes a line of the input, as with a trailing backslash but keeping the
+    // newline, so a pasted script is evaluated as one chunk once Enter is pressed.
+    void paste(std::vector<std::string>& buffer_lines, std::string& prompt, std::string& line, size_t& cursor_pos) {
+        std::string tail = line.substr(cursor_pos);
+        line.erase(cursor_pos);
+        bool multiline = false;
+        char c;
+        while (read_byte(c) == 1) {
+            if (c == '\x1b') {
+                std::string seq;
+                if (!read_escape(seq) || seq == "[201~") break;
+                continue;
+            }
+            if (c == '\r' || c == '\n') {
+                if (!multiline) out_ += "\r\033[K" + prompt;
+                multiline = true;
+                out_ += line + "\n" + more_prompt_;
+                buffer_lines.push_back(line + "\n");
+                line.clear();
+                prompt = more_prompt_;
+            } else if (c == '\t' || static_cast<unsigned char>(c) >= 0x20) {
+                line += c;
+            }
+        }
+        cursor_pos = line.size();
+        line += tail;
+        redraw_line(prompt, line, cursor_pos);
+    }
 
     void redraw_line(const std::string& prompt, const std::string& line, size_t cursor_pos) {
-        std::cout << "\r\033[K" << prompt << line << std::flush;
+        out_ += "\r\033[K" + prompt + line;
         size_t total_pos = prompt.size() + line.size();
         size_t desired_pos = prompt.size() + cursor_pos;
         if (desired_pos < total_pos) {
             size_t move_left = total_pos - desired_pos;
-            std::cout << "\x1b[" << move_left << "D" << std::flush;
+            out_ += "\x1b[" + std::to_string(move_left) + "D";
         }
     }
 
+    // Runs input as a meta-command if ':' is followed by a registered name; anything else,
+    // e.g. a Lua label such as ::continue::, is ordinary input and returns false.
+    bool run_command(const std::string& input) {
+        if (input.empty() || input[0] != ':') return false;
+        size_t space = input.find_first_of(" \t");
+        std::string name = input.substr(1, space == std::string::npos ? std::string::npos : space - 1);
+        auto it = commands_.find(name);
+        if (it == commands_.end()) return false;
+        it->second.callback(space == std::string::npos ? "" : input.substr(space + 1));
+        return true;
+    }
+
     std::string join_lines(const std::vector<std::string>& lines) {
         std::string result;
         for (const auto& l : lines) {